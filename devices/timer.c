@@ -5,8 +5,10 @@
 #include <stdio.h>
 #include "threads/interrupt.h"
 #include "threads/io.h"
+#include "threads/profile.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
+#include "intrinsic.h"
 
 /* See [8254] for hardware details of the 8254 timer chip. */
 // TIMER_FREQ 최소값 및 최소값 설정
@@ -19,6 +21,32 @@
 
 /* Number of timer ticks since OS booted. */
 static int64_t ticks;
+static struct seqlock ticks_seq;
+
+/* If false (default), the timer interrupts TIMER_FREQ times per
+   second no matter what.
+   If true, the periodic tick is stopped while the idle thread
+   runs and the timer is programmed to fire only when the next
+   thread is due to wake up.
+   Controlled by kernel command-line option "-tickless". */
+bool timer_tickless;
+
+/* 8254 input frequency divided by TIMER_FREQ, rounded to nearest.
+   That is, the number of PIT cycles in one timer tick. */
+#define PIT_TICK_COUNT ((1193180 + TIMER_FREQ / 2) / TIMER_FREQ)
+
+/* Dynamic tick state, valid while idle_skip > 0.  The PIT is then
+   in one-shot mode, counting down idle_count cycles, and will
+   interrupt on what would have been the idle_skip'th periodic tick.
+   The first of those ticks was idle_first cycles away when the
+   one-shot was armed. */
+static int64_t idle_skip;
+static unsigned idle_count;
+static unsigned idle_first;
+
+/* Cost of timer_interrupt(), in TSC cycles. */
+static struct timer_intr_stats intr_stats;
+static struct seqlock intr_stats_seq;
 
 /* Number of loops per timer tick.
    Initialized by timer_calibrate(). */
@@ -28,20 +56,18 @@ static intr_handler_func timer_interrupt;
 static bool too_many_loops (unsigned loops);
 static void busy_wait (int64_t loops);
 static void real_time_sleep (int64_t num, int32_t denom);
+static void pit_set_periodic (void);
+static void pit_set_oneshot (unsigned count);
+static unsigned pit_read_count (void);
 
 /* Sets up the 8254 Programmable Interval Timer (PIT) to
    interrupt PIT_FREQ times per second, and registers the
    corresponding interrupt. */
 void
 timer_init (void) {
-	/* 8254 input frequency divided by TIMER_FREQ, rounded to
-	   nearest. */
-	uint16_t count = (1193180 + TIMER_FREQ / 2) / TIMER_FREQ;
-
-	outb (0x43, 0x34);    /* CW: counter 0, LSB then MSB, mode 2, binary. */
-	outb (0x40, count & 0xff);
-	outb (0x40, count >> 8);
-
+	seqlock_init (&ticks_seq);
+	seqlock_init (&intr_stats_seq);
+	pit_set_periodic ();
 	intr_register_ext (0x20, timer_interrupt, "8254 Timer");
 }
 
@@ -74,10 +100,13 @@ timer_calibrate (void) {
 /* Returns the number of timer ticks since the OS booted. */
 int64_t
 timer_ticks (void) {
-	enum intr_level old_level = intr_disable ();
-	int64_t t = ticks;	// ticks(OS 부팅 이후 타이머 틱 수)의 현재값 저장. 계속 올라감.
-	intr_set_level (old_level);	// old_level에 저장된 이전 인터럽트 상태 복원
-	barrier ();
+	unsigned seq;
+	int64_t t;
+
+	do {	// 읽는 도중 타이머 인터럽트가 ticks를 바꿨으면 다시 읽는다
+		seq = seqlock_read_begin (&ticks_seq);
+		t = ticks;	// ticks(OS 부팅 이후 타이머 틱 수)의 현재값 저장. 계속 올라감.
+	} while (seqlock_read_retry (&ticks_seq, seq));
 	return t;	// 현재 타이머 틱 수 반환
 }
 
@@ -129,28 +158,179 @@ timer_print_stats (void) {
 	printf ("Timer: %"PRId64" ticks\n", timer_ticks ());
 }
 
+/* Called by the idle thread, with interrupts off, just before it
+   halts the CPU.  In tickless mode, stops the periodic tick and
+   arms the timer to fire on the tick at which the next sleeping
+   thread is due, or at the next MLFQS load average update,
+   whichever comes first.  The 16-bit PIT counter limits a single
+   skip to about 55 ms. */
+void
+timer_idle_enter (void) {
+	int64_t deadline, skip;
+	unsigned first;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	if (!timer_tickless || idle_skip > 0)
+		return;
+
+	deadline = thread_next_wakeup ();
+	if (thread_mlfqs && deadline > (ticks / TIMER_FREQ + 1) * TIMER_FREQ)
+		deadline = (ticks / TIMER_FREQ + 1) * TIMER_FREQ;
+
+	skip = deadline - ticks;
+	first = pit_read_count ();
+	if (skip > (0xffff - first) / PIT_TICK_COUNT + 1)
+		skip = (0xffff - first) / PIT_TICK_COUNT + 1;
+	if (skip <= 1)
+		return;
+
+	idle_skip = skip;
+	idle_first = first;
+	idle_count = first + (skip - 1) * PIT_TICK_COUNT;
+	pit_set_oneshot (idle_count);
+}
+
+/* Called by the scheduler, with interrupts off, when the idle
+   thread gives up the CPU.  If the periodic tick is stopped,
+   accounts for the ticks that went by since the idle thread armed
+   the one-shot, and re-arms it to fire on the next tick boundary,
+   where timer_interrupt() resumes periodic mode. */
+void
+timer_idle_exit (void) {
+	unsigned elapsed, next;
+	int64_t passed;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	if (idle_skip <= 1)
+		return;
+
+	/* Read-back command: latch status of counter 0.  Bit 7 is the
+	   OUT pin, which goes high when a mode 0 count expires.  The
+	   interrupt is then pending and will finish the job. */
+	outb (0x43, 0xe2);
+	if (inb (0x40) & 0x80) {
+		passed = idle_skip - 1;
+		idle_skip = 1;
+	} else {
+		elapsed = idle_count - pit_read_count ();
+		passed = elapsed < idle_first
+		         ? 0 : (elapsed - idle_first) / PIT_TICK_COUNT + 1;
+		if (passed > idle_skip - 1)
+			passed = idle_skip - 1;
+		idle_skip = 1;
+		next = idle_first + passed * PIT_TICK_COUNT - elapsed;
+		pit_set_oneshot (next > 0 ? next : 1);
+	}
+
+	seqlock_write_begin (&ticks_seq);
+	ticks += passed;
+	seqlock_write_end (&ticks_seq);
+	thread_tick_idle (passed);
+}
+
+/* Copies the timer interrupt cost statistics gathered since the
+   last timer_reset_intr_stats() into *STATS. */
+void
+timer_get_intr_stats (struct timer_intr_stats *stats) {
+	unsigned seq;
+
+	do {
+		seq = seqlock_read_begin (&intr_stats_seq);
+		*stats = intr_stats;
+	} while (seqlock_read_retry (&intr_stats_seq, seq));
+}
+
+/* Clears the timer interrupt cost statistics. */
+void
+timer_reset_intr_stats (void) {
+	enum intr_level old_level = intr_disable ();
+	seqlock_write_begin (&intr_stats_seq);
+	intr_stats.cnt = 0;
+	intr_stats.total_cycles = 0;
+	intr_stats.max_cycles = 0;
+	seqlock_write_end (&intr_stats_seq);
+	intr_set_level (old_level);
+}
+
 /* Timer interrupt handler. */
 static void
-timer_interrupt (struct intr_frame *args UNUSED) {	// 매 tick마다 해당 tick에 깨워야 할 쓰레드들 깨우기
-	ticks++;	// 시간 계속 흐르니까 틱도 계속 증가.
+timer_interrupt (struct intr_frame *args) {	// 매 tick마다 해당 tick에 깨워야 할 쓰레드들 깨우기
+	uint64_t start = rdtsc ();
+	uint64_t cycles;
+	int64_t passed = 1;
+
+	profile_sample (args);
+
+	/* Coming out of a dynamic tick: account for the ticks the idle
+	   thread slept through and go back to periodic mode. */
+	if (idle_skip > 0) {
+		pit_set_periodic ();
+		thread_tick_idle (idle_skip - 1);
+		passed = idle_skip;
+		idle_skip = 0;
+	}
+
+	seqlock_write_begin (&ticks_seq);
+	ticks += passed;	// 시간 계속 흐르니까 틱도 계속 증가.
+	seqlock_write_end (&ticks_seq);
 	thread_tick ();	// ticks => 깨울 시간
 
 	if (thread_mlfqs){
-		mlfqs_increment();	// timer_interrupt 발생할 때마다(= 틱 증가할 때마다, 위에 정의되어 있음) recuent_cpu 1 증가
+		mlfqs_increment();	// timer_interrupt 발생할 때마다(= 틱 증가할 때마다) recent_cpu 1 증가
 
-		/* 매 4tick마다 현재 실행 중인 쓰레드의 priority 계산 => 모든 프로세스의 우선순위 다시 계산하는거 아닌가 ???*/
-		if (timer_ticks() % 4 == 0){	// 왜 thread_ticks 아니고 timer_ticks() 사용하지?
-			mlfqs_priority(thread_current());
-			// 1초마다 모든 프로세스의 recent_cpu 업데이트
-			// 근데 왜 여기선 현재 쓰레드만의 load_avg, recent_cpu 계산??
-			if (timer_ticks() % TIMER_FREQ == 0){
-				mlfqs_load_avg();
-				// mlfqs_recent_cpu(thread_current());
-				mlfqs_recalc();	// why..........
-			}
+		/* 1초마다 load_avg 갱신, 새 decay epoch 시작 */
+		if (ticks % TIMER_FREQ == 0){
+			mlfqs_load_avg();
+			mlfqs_recalc();
 		}
+		/* 매 4tick마다 현재 쓰레드의 priority 재계산.
+		   다른 쓰레드의 recent_cpu는 decay 때만 바뀌므로 mlfqs_sweep()이 처리 */
+		if (ticks % 4 == 0)
+			mlfqs_priority(thread_current());
+		mlfqs_sweep();
 	}
-	thread_awake (ticks);	// ticks에 깨운다
+	if (ticks >= thread_next_wakeup ())	// 깨울 쓰레드가 있을 때만
+		thread_awake (ticks);	// ticks에 깨운다
+
+	cycles = rdtsc () - start;
+	seqlock_write_begin (&intr_stats_seq);
+	intr_stats.cnt++;
+	intr_stats.total_cycles += cycles;
+	if (cycles > intr_stats.max_cycles)
+		intr_stats.max_cycles = cycles;
+	seqlock_write_end (&intr_stats_seq);
+}
+
+/* Programs PIT counter 0 to interrupt every PIT_TICK_COUNT
+   cycles, that is, TIMER_FREQ times per second. */
+static void
+pit_set_periodic (void) {
+	outb (0x43, 0x34);    /* CW: counter 0, LSB then MSB, mode 2, binary. */
+	outb (0x40, PIT_TICK_COUNT & 0xff);
+	outb (0x40, PIT_TICK_COUNT >> 8);
+}
+
+/* Programs PIT counter 0 to interrupt once, COUNT cycles from now. */
+static void
+pit_set_oneshot (unsigned count) {
+	ASSERT (count > 0 && count <= 0xffff);
+
+	outb (0x43, 0x30);    /* CW: counter 0, LSB then MSB, mode 0, binary. */
+	outb (0x40, count & 0xff);
+	outb (0x40, count >> 8);
+}
+
+/* Returns the current value of PIT counter 0. */
+static unsigned
+pit_read_count (void) {
+	unsigned lsb, msb;
+
+	outb (0x43, 0x00);    /* CW: counter 0, latch count. */
+	lsb = inb (0x40);
+	msb = inb (0x40);
+	return lsb | (msb << 8);
 }
 
 /* Returns true if LOOPS iterations waits for more than one timer
@@ -2,11 +2,15 @@
 #define DEVICES_TIMER_H
 
 #include <round.h>
+#include <stdbool.h>
 #include <stdint.h>
 
 /* Number of timer interrupts per second. */
 #define TIMER_FREQ 100
 
+/* Stop the periodic tick while idle?  See timer.c. */
+extern bool timer_tickless;
+
 void timer_init (void);
 void timer_calibrate (void);
 
@@ -18,6 +22,19 @@ void timer_msleep (int64_t milliseconds);
 void timer_usleep (int64_t microseconds);
 void timer_nsleep (int64_t nanoseconds);
 
+void timer_idle_enter (void);
+void timer_idle_exit (void);
+
 void timer_print_stats (void);
 
+/* Timer interrupt handler cost, in TSC cycles. */
+struct timer_intr_stats {
+	int64_t cnt;                /* Interrupts handled. */
+	uint64_t total_cycles;      /* Cycles spent in all of them. */
+	uint64_t max_cycles;        /* Cycles spent in the slowest one. */
+};
+
+void timer_get_intr_stats (struct timer_intr_stats *);
+void timer_reset_intr_stats (void);
+
 #endif /* devices/timer.h */
@@ -18,7 +18,12 @@
  * conversion from a struct hash_elem back to a structure object
  * that contains it.  This is the same technique used in the
  * linked list implementation.  Refer to lib/kernel/list.h for a
- * detailed explanation. */
+ * detailed explanation.
+ *
+ * When the table grows or shrinks, the old array of buckets is
+ * kept next to the new one and emptied a few buckets at a time
+ * by later insertions and deletions, so that no single call has
+ * to move every element. */
 
 #include <stdbool.h>
 #include <stddef.h>
@@ -59,6 +64,9 @@ struct hash {
 	size_t elem_cnt;            /* Number of elements in table. */
 	size_t bucket_cnt;          /* Number of buckets, a power of 2. */
 	struct list *buckets;       /* Array of `bucket_cnt' lists. */
+	size_t old_bucket_cnt;      /* Number of buckets in `old_buckets'. */
+	struct list *old_buckets;   /* Buckets being moved, or null. */
+	size_t move_idx;            /* Old buckets before this are empty. */
 	hash_hash_func *hash;       /* Hash function. */
 	hash_less_func *less;       /* Comparison function. */
 	void *aux;                  /* Auxiliary data for `hash' and `less'. */
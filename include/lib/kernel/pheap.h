@@ -0,0 +1,66 @@
+#ifndef __LIB_KERNEL_PHEAP_H
+#define __LIB_KERNEL_PHEAP_H
+
+/* Pairing heap.
+ *
+ * A max-heap of elements ordered by a caller-supplied comparison
+ * function.  Insertion and reading the maximum take O(1) time;
+ * removing the maximum or an arbitrary element takes O(log n)
+ * amortized time.  Changing an element's key is a removal
+ * followed by an insertion.
+ *
+ * Like the linked list in list.h, the heap does not use dynamic
+ * allocation.  Each structure that can be in a heap embeds a
+ * struct pheap_elem member, and pheap_entry() converts a pointer
+ * to that member back into a pointer to the structure.  An
+ * element may be in at most one heap at a time through a given
+ * struct pheap_elem. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Heap element. */
+struct pheap_elem {
+	struct pheap_elem *child;   /* Leftmost child. */
+	struct pheap_elem *next;    /* Right sibling. */
+	struct pheap_elem *prev;    /* Left sibling, or parent of a
+	                               leftmost child, or NULL at the root. */
+};
+
+/* Converts pointer to heap element PHEAP_ELEM into a pointer to
+   the structure that PHEAP_ELEM is embedded inside.  Supply the
+   name of the outer structure STRUCT and the member name MEMBER
+   of the heap element. */
+#define pheap_entry(PHEAP_ELEM, STRUCT, MEMBER)           \
+	((STRUCT *) ((uint8_t *) &(PHEAP_ELEM)->child     \
+		- offsetof (STRUCT, MEMBER.child)))
+
+/* Compares the value of two heap elements A and B, given
+   auxiliary data AUX.  Returns true if A is less than B, or
+   false if A is greater than or equal to B. */
+typedef bool pheap_less_func (const struct pheap_elem *a,
+                              const struct pheap_elem *b,
+                              void *aux);
+
+/* Pairing heap. */
+struct pheap {
+	struct pheap_elem *root;    /* Maximum element, or NULL. */
+	size_t elem_cnt;            /* Number of elements. */
+	pheap_less_func *less;      /* Comparison function. */
+	void *aux;                  /* Auxiliary data for `less'. */
+};
+
+void pheap_init (struct pheap *, pheap_less_func *, void *aux);
+
+void pheap_insert (struct pheap *, struct pheap_elem *);
+void pheap_remove (struct pheap *, struct pheap_elem *);
+void pheap_update (struct pheap *, struct pheap_elem *);
+
+struct pheap_elem *pheap_max (const struct pheap *);
+struct pheap_elem *pheap_pop_max (struct pheap *);
+
+size_t pheap_size (const struct pheap *);
+bool pheap_empty (const struct pheap *);
+
+#endif /* lib/kernel/pheap.h */
@@ -0,0 +1,87 @@
+#ifndef __LIB_KERNEL_RHASH_H
+#define __LIB_KERNEL_RHASH_H
+
+/* Open-addressing hash table.
+ *
+ * A variant of the hash table in hash.h for tables with many
+ * elements.  It uses the same struct hash_elem and the same hash
+ * and comparison functions, so that a structure can move from one
+ * kind of table to the other by changing only the calls, but it
+ * keeps pointers to the elements in a flat array of slots instead
+ * of chaining them into lists.  Each slot also caches part of its
+ * element's hash value, so that a lookup rarely has to touch an
+ * element other than the one it is looking for.
+ *
+ * Collisions are resolved by linear probing with "Robin Hood"
+ * insertion: an element being inserted takes the slot of any
+ * element that is closer to its home slot than the new element is
+ * to its own, and that element moves on instead.  This keeps
+ * probe sequences short and even at high load, and lets a lookup
+ * stop as soon as it passes where its element would have been.
+ *
+ * When the table grows or shrinks, it keeps the old array of
+ * slots next to the new one and moves a few slots over on each
+ * insertion or deletion, instead of all at once.  Lookups search
+ * both arrays until the move is done.
+ *
+ * The `list_elem' inside each struct hash_elem is not used. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "hash.h"
+
+/* Slot. */
+struct rhash_slot {
+	uint32_t hash;              /* Low bits of the element's hash. */
+	uint32_t dist;              /* 1 + distance from home, 0 if empty. */
+	struct hash_elem *elem;     /* Element, or a null pointer. */
+};
+
+/* Hash table. */
+struct rhash {
+	size_t elem_cnt;            /* Number of elements in table. */
+	size_t slot_cnt;            /* Number of slots, a power of 2. */
+	struct rhash_slot *slots;   /* Array of `slot_cnt' slots. */
+
+	/* Slots still being moved into `slots', if any. */
+	struct rhash_slot *old_slots;   /* Old array, or a null pointer. */
+	size_t old_slot_cnt;        /* Number of slots in `old_slots'. */
+	size_t old_elem_cnt;        /* Elements left in `old_slots'. */
+	size_t move_idx;            /* Next old slot to move. */
+
+	hash_hash_func *hash;       /* Hash function. */
+	hash_less_func *less;       /* Comparison function. */
+	void *aux;                  /* Auxiliary data for `hash' and `less'. */
+};
+
+/* A hash table iterator. */
+struct rhash_iterator {
+	struct rhash *hash;         /* The hash table. */
+	size_t idx;                 /* Slot index, counting old slots first. */
+	struct hash_elem *elem;     /* Current hash element. */
+};
+
+/* Basic life cycle. */
+bool rhash_init (struct rhash *, hash_hash_func *, hash_less_func *,
+		void *aux);
+void rhash_clear (struct rhash *, hash_action_func *);
+void rhash_destroy (struct rhash *, hash_action_func *);
+
+/* Search, insertion, deletion. */
+struct hash_elem *rhash_insert (struct rhash *, struct hash_elem *);
+struct hash_elem *rhash_replace (struct rhash *, struct hash_elem *);
+struct hash_elem *rhash_find (struct rhash *, struct hash_elem *);
+struct hash_elem *rhash_delete (struct rhash *, struct hash_elem *);
+
+/* Iteration. */
+void rhash_apply (struct rhash *, hash_action_func *);
+void rhash_first (struct rhash_iterator *, struct rhash *);
+struct hash_elem *rhash_next (struct rhash_iterator *);
+struct hash_elem *rhash_cur (struct rhash_iterator *);
+
+/* Information. */
+size_t rhash_size (struct rhash *);
+bool rhash_empty (struct rhash *);
+
+#endif /* lib/kernel/rhash.h */
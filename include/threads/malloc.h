@@ -2,12 +2,59 @@
 #define THREADS_MALLOC_H
 
 #include <debug.h>
+#include <list.h>
 #include <stddef.h>
+#include <stdint.h>
+#include "threads/synch.h"
+
+/* Allocation statistics. */
+struct malloc_stats {
+	uint64_t alloc_cnt;         /* Number of allocations. */
+	uint64_t requested;         /* Bytes requested. */
+	uint64_t granted;           /* Bytes granted. */
+};
 
 void malloc_init (void);
 void *malloc (size_t) __attribute__ ((malloc));
 void *calloc (size_t, size_t) __attribute__ ((malloc));
 void *realloc (void *, size_t);
 void free (void *);
+void malloc_get_stats (size_t block_size, struct malloc_stats *);
+void malloc_print_stats (void);
+
+/* Object cache.
+ *
+ * Hands out objects of a single size, packed into page-sized
+ * slabs without the power-of-2 rounding of malloc().  If the
+ * cache has a constructor, it runs once on each object when its
+ * slab is created, and a freed object is expected to be back in
+ * its constructed state, so that the next kmem_cache_alloc() can
+ * hand it out again as is. */
+struct kmem_cache {
+	char name[16];              /* Name, for statistics. */
+	size_t obj_size;            /* Object size, rounded up for alignment. */
+	size_t link_ofs;            /* Offset of free link within a slot. */
+	size_t slot_size;           /* Bytes per object in a slab. */
+	size_t objs_per_slab;       /* Number of objects in a slab. */
+	void (*ctor) (void *);      /* Constructor, or a null pointer. */
+
+	struct lock lock;           /* Protects the members below. */
+	struct list partial_slabs;  /* Slabs with free and used objects. */
+	struct list full_slabs;     /* Slabs without free objects. */
+	struct list empty_slabs;    /* Slabs without used objects. */
+	size_t empty_cnt;           /* Number of slabs in empty_slabs. */
+	size_t obj_cnt;             /* Objects in use. */
+	size_t peak_obj_cnt;        /* Most objects ever in use. */
+	size_t slab_cnt;            /* Slabs allocated. */
+	size_t peak_slab_cnt;       /* Most slabs ever allocated. */
+
+	struct list_elem elem;      /* Element in list of all caches. */
+};
+
+void kmem_cache_init (struct kmem_cache *, const char *name, size_t size,
+		void (*ctor) (void *));
+void *kmem_cache_alloc (struct kmem_cache *) __attribute__ ((malloc));
+void kmem_cache_free (struct kmem_cache *, void *);
+void kmem_print_stats (void);
 
 #endif /* threads/malloc.h */
@@ -1,9 +1,12 @@
 #ifndef THREADS_PALLOC_H
 #define THREADS_PALLOC_H
 
+#include <stdbool.h>
 #include <stdint.h>
 #include <stddef.h>
 
+struct thread;
+
 /* How to allocate pages. */
 enum palloc_flags {
 	PAL_ASSERT = 001,           /* Panic on failure. */
@@ -14,10 +17,33 @@ enum palloc_flags {
 /* Maximum number of pages to put in user pool. */
 extern size_t user_page_limit;
 
+/* Cache single pages in per-thread magazines?  On by default. */
+extern bool palloc_magazines;
+
+/* Number of pages a magazine can hold. */
+#define PALLOC_MAG_SIZE 8
+
+/* A thread's cache of recently freed single pages from one pool. */
+struct palloc_magazine {
+	size_t cnt;                     /* Number of pages held. */
+	void *pages[PALLOC_MAG_SIZE];   /* Pages, most recently freed last. */
+};
+
+/* Page allocator activity. */
+struct palloc_stats {
+	uint64_t pool_trips;            /* Times the pool itself was used. */
+	uint64_t magazine_hits;         /* Pages served from a magazine. */
+	uint64_t zeroed_hits;           /* PAL_ZERO pages served pre-zeroed. */
+};
+
 uint64_t palloc_init (void);
 void *palloc_get_page (enum palloc_flags);
 void *palloc_get_multiple (enum palloc_flags, size_t page_cnt);
 void palloc_free_page (void *);
 void palloc_free_multiple (void *, size_t page_cnt);
+void palloc_reclaim_magazines (struct thread *);
+void palloc_get_stats (enum palloc_flags, struct palloc_stats *);
+void palloc_print_stats (void);
+bool palloc_zero_idle (void);
 
 #endif /* threads/palloc.h */
@@ -0,0 +1,22 @@
+#ifndef THREADS_PROFILE_H
+#define THREADS_PROFILE_H
+
+#include <stdbool.h>
+
+struct intr_frame;
+
+/* Deepest backtrace recorded with each sample, not counting the
+   interrupted instruction itself. */
+#define PROFILE_MAX_DEPTH 15
+
+/* -profile: Sample the running code on every timer tick? */
+extern bool profile_enabled;
+
+/* -profile=DEPTH: Number of callers to record with each sample. */
+extern unsigned profile_depth;
+
+void profile_init (void);
+void profile_sample (const struct intr_frame *);
+void profile_dump (void);
+
+#endif /* threads/profile.h */
@@ -2,12 +2,51 @@
 #define THREADS_SYNCH_H
 
 #include <list.h>
+#include <pheap.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Wait queue.
+ *
+ * Holds the threads blocked on a synchronization primitive and
+ * hands them out highest priority first, first come first served
+ * among threads of equal priority.  Insertion takes O(1) time and
+ * removal O(log n) amortized.  A waiter whose priority changes
+ * while it is queued (say, through donation) is moved to its new
+ * place by waitq_rekey(). */
+struct waitq {
+	struct pheap heap;          /* Waiters, by priority then arrival. */
+	unsigned next_seq;          /* Arrival stamp for the next waiter. */
+};
+
+/* Wait queue element. */
+struct waitq_elem {
+	struct pheap_elem heap_elem; /* Element in `queue->heap'. */
+	struct list_elem thread_elem; /* Element in thread's `waitqs'. */
+	struct thread *thread;      /* Waiting thread. */
+	struct waitq *queue;        /* Queue we are in. */
+	unsigned seq;               /* Arrival stamp. */
+};
+
+/* Converts pointer to wait queue element WAITQ_ELEM into a
+   pointer to the structure that WAITQ_ELEM is embedded inside. */
+#define waitq_entry(WAITQ_ELEM, STRUCT, MEMBER)           \
+	((STRUCT *) ((uint8_t *) (WAITQ_ELEM)             \
+		- offsetof (STRUCT, MEMBER)))
+
+void waitq_init (struct waitq *);
+bool waitq_empty (const struct waitq *);
+void waitq_push (struct waitq *, struct waitq_elem *, struct thread *);
+struct waitq_elem *waitq_pop (struct waitq *);
+void waitq_remove (struct waitq_elem *);
+int waitq_max_priority (const struct waitq *);
+void waitq_rekey (struct thread *);
 
 /* A counting semaphore. */
 struct semaphore {
 	unsigned value;             /* Current value. */
-	struct list waiters;        /* List of waiting threads. */
+	struct waitq waiters;       /* Waiting threads. */
 };
 
 void sema_init (struct semaphore *, unsigned value);
@@ -16,21 +55,51 @@ bool sema_try_down (struct semaphore *);
 void sema_up (struct semaphore *);
 void sema_self_test (void);
 
+#ifdef LOCK_STATS
+/* Number of buckets in a lock's hold-time histogram.  Bucket I
+   counts holds shorter than 4**(I + 1) TSC cycles, except that
+   the last bucket also counts all longer ones. */
+#define LOCK_HOLD_BUCKETS 16
+
+/* Contention statistics, shared by all the locks registered under
+   the same name. */
+struct lock_stats {
+	char name[24];              /* Name given to lock_init_named(). */
+	uint64_t acquisitions;      /* Times acquired. */
+	uint64_t contended;         /* Times a thread had to wait. */
+	int64_t wait_ticks;         /* Total timer ticks spent waiting. */
+	int64_t max_wait_ticks;     /* Longest wait, in timer ticks. */
+	uint64_t hold_hist[LOCK_HOLD_BUCKETS]; /* Hold times. */
+};
+#endif
+
 /* Lock. */
 struct lock {
 	struct thread *holder;      /* Thread holding lock (for debugging). */
 	struct semaphore semaphore; /* Binary semaphore controlling access. */
+	struct pheap_elem held_elem; /* Element in holder's `held_locks'. */
+#ifdef LOCK_STATS
+	struct lock_stats *stats;   /* Statistics, or NULL if unnamed. */
+	uint64_t acquired_at;       /* TSC when last acquired. */
+#endif
 };
 
 void lock_init (struct lock *);
+void lock_init_named (struct lock *, const char *name);
 void lock_acquire (struct lock *);
 bool lock_try_acquire (struct lock *);
 void lock_release (struct lock *);
 bool lock_held_by_current_thread (const struct lock *);
+int lock_donated_priority (const struct lock *);
+#ifdef LOCK_STATS
+void lock_print_stats (void);
+#endif
+bool lock_donation_less (const struct pheap_elem *, const struct pheap_elem *,
+                         void *aux);
 
 /* Condition variable. */
 struct condition {
-	struct list waiters;        /* List of waiting threads. */
+	struct waitq waiters;       /* Waiting threads. */
 };
 
 void cond_init (struct condition *);
@@ -38,6 +107,49 @@ void cond_wait (struct condition *, struct lock *);
 void cond_signal (struct condition *, struct lock *);
 void cond_broadcast (struct condition *, struct lock *);
 
+/* Readers-writer lock.
+ *
+ * Any number of readers or a single writer may hold it at once.
+ * Writers take precedence: once a writer is waiting, newly
+ * arriving readers queue up behind it.  The writer holds `lock'
+ * for as long as it holds the rwlock, so threads that block on a
+ * writer donate their priority to it. */
+struct rwlock {
+	struct lock lock;           /* Held by the writer. */
+	unsigned readers;           /* Number of readers holding it. */
+	bool draining;              /* Writer waiting for readers to leave? */
+	struct semaphore drained;   /* Upped when the last reader leaves. */
+};
+
+void rwlock_init (struct rwlock *);
+void rwlock_acquire_read (struct rwlock *);
+void rwlock_release_read (struct rwlock *);
+void rwlock_acquire_write (struct rwlock *);
+void rwlock_release_write (struct rwlock *);
+bool rwlock_held_for_write (const struct rwlock *);
+
+/* Sequence lock.
+ *
+ * Lets readers of a small structure that is updated from an
+ * interrupt handler take a consistent snapshot without turning
+ * interrupts off: a reader copies the data and then retries if a
+ * write happened meanwhile.  Writers must run with interrupts
+ * off, which also serializes them.
+ *
+ *	do {
+ *		seq = seqlock_read_begin (&sl);
+ *		copy = data;
+ *	} while (seqlock_read_retry (&sl, seq)); */
+struct seqlock {
+	unsigned seq;               /* Odd while a write is under way. */
+};
+
+void seqlock_init (struct seqlock *);
+unsigned seqlock_read_begin (const struct seqlock *);
+bool seqlock_read_retry (const struct seqlock *, unsigned seq);
+void seqlock_write_begin (struct seqlock *);
+void seqlock_write_end (struct seqlock *);
+
 /* Optimization barrier.
  *
  * The compiler will not reorder operations across an
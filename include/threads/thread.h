@@ -3,8 +3,11 @@
 
 #include <debug.h>
 #include <list.h>
+#include <pheap.h>
 #include <stdint.h>
 #include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
 #ifdef VM
 #include "vm/vm.h"
 #endif
@@ -94,10 +97,20 @@ struct thread {
 	tid_t tid;                          /* Thread identifier. */
 	enum thread_status status;          /* Thread state. */
 	char name[16];                      /* Name (for debugging purposes). */
-	int priority;                       /* Priority. */
+	int priority;                       /* Effective priority. */
+	int base_priority;                  /* Priority before donation. */
 	int64_t wakeup_tick;						/* 깨울 시간 (ticks 값) */
 
-	struct lock *wait_on_lock;
+	/* Priority donation. */
+	struct lock *wait_on_lock;          /* Lock being waited for, if any. */
+	struct pheap held_locks;            /* Held locks, by donated priority. */
+
+	/* Owned by synch.c. */
+	struct waitq_elem wait_elem;        /* Element in a semaphore's waiters. */
+	struct list waitqs;                 /* Wait queue elements we are in. */
+
+	/* Owned by palloc.c. */
+	struct palloc_magazine page_mags[2]; /* Kernel and user page caches. */
 
 	/* Shared between thread.c and synch.c. */
 	struct list_elem elem;              /* List element. */
@@ -117,7 +130,8 @@ struct thread {
 	unsigned magic;                     /* Detects stack overflow. */
 
 	int nice;
-	int recent_cpu;	// 왜 int형으로 선언? recent_cpu는 real number 아닌가 ..!!!!...!!!!!!! ??????
+	int recent_cpu;	// 17.14 고정 소수점
+	unsigned decay_epoch;	// recent_cpu에 마지막으로 decay 적용한 epoch
 };
 
 /* If false (default), use round-robin scheduler.
@@ -129,6 +143,7 @@ void thread_init (void);
 void thread_start (void);
 
 void thread_tick (void);
+void thread_tick_idle (int64_t cnt);
 void thread_print_stats (void);
 
 typedef void thread_func (void *aux);
@@ -139,6 +154,7 @@ void thread_unblock (struct thread *);	// wakeup 상태
 
 void thread_sleep(int64_t);
 void thread_awake(int64_t);
+int64_t thread_next_wakeup (void);
 
 struct thread *thread_current (void);
 tid_t thread_tid (void);
@@ -147,9 +163,14 @@ const char *thread_name (void);
 void thread_exit (void) NO_RETURN;
 void thread_yield (void);
 
+/* Performs some operation on thread t, given auxiliary data AUX. */
+typedef void thread_action_func (struct thread *t, void *aux);
+void thread_foreach (thread_action_func *, void *);
+
 int thread_get_priority (void);
 void thread_set_priority (int);
-bool thread_compare_priority(struct list_elem *, struct list_elem *,void *aux UNUSED);
+void thread_change_priority (struct thread *, int);
+bool thread_refresh_priority (struct thread *);
 
 void thread_test_preemption (void);
 
@@ -163,7 +184,7 @@ void mlfqs_recent_cpu (struct thread *t);
 void mlfqs_load_avg (void);
 void mlfqs_increment (void);
 void mlfqs_recalc (void);
-int load_avg;
+void mlfqs_sweep (void);
 
 void do_iret (struct intr_frame *tf);
 
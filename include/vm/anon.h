@@ -1,13 +1,25 @@
 #ifndef VM_ANON_H
 #define VM_ANON_H
+#include <stddef.h>
 #include "vm/vm.h"
 struct page;
 enum vm_type;
 
+/* Most pages moved to or from swap by one disk command. */
+#define SWAP_CLUSTER 8
+
+/* Value of `slot' for a page that is not in swap. */
+#define SWAP_SLOT_NONE ((size_t) -1)
+
 struct anon_page {
+	size_t slot;            /* Swap slot holding the page, or SWAP_SLOT_NONE. */
 };
 
 void vm_anon_init (void);
 bool anon_initializer (struct page *page, enum vm_type type, void *kva);
+size_t anon_swap_out_cluster (struct page *pages[], size_t cnt);
+void anon_swap_in_cluster (struct page *pages[], void *kvas[], size_t cnt);
+void anon_swap_share (struct page *page, struct page *sharer);
+void anon_print_stats (void);
 
 #endif
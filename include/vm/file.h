@@ -6,11 +6,28 @@
 struct page;
 enum vm_type;
 
+/* Where a file-backed page's contents come from: READ_BYTES bytes
+ * of FILE starting at OFS, followed by zeros up to the end of the
+ * page.  Also passed, allocated with malloc(), as the AUX of
+ * file_page_load() for pages that are still to be loaded. */
 struct file_page {
+	struct file *file;      /* Private handle to the file. */
+	off_t ofs;              /* Offset of the page's contents in FILE. */
+	size_t read_bytes;      /* Bytes read from FILE; the rest are zero. */
+	bool text;              /* Read-only segment of an executable. */
+	void *map_addr;         /* Start of the page's mapping, or NULL. */
 };
 
 void vm_file_init (void);
 bool file_backed_initializer (struct page *page, enum vm_type type, void *kva);
+struct file_page *file_page_create (struct file *file, off_t ofs,
+		size_t read_bytes);
+struct file_page *file_page_duplicate (const struct file_page *load);
+void file_page_free (struct file_page *load);
+bool file_page_load (struct page *page, void *aux);
+struct file_page *file_page_source (struct page *page);
+void file_page_skip_load (struct page *page);
+bool file_page_adjacent (struct page *page, struct page *next);
 void *do_mmap(void *addr, size_t length, int writable,
 		struct file *file, off_t offset);
 void do_munmap (void *va);
@@ -1,6 +1,10 @@
 #ifndef VM_VM_H
 #define VM_VM_H
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <hash.h>
+#include <list.h>
 #include "threads/palloc.h"
 
 enum vm_type {
@@ -46,6 +50,10 @@ struct page {
 	struct frame *frame;   /* Back reference for frame */
 
 	/* Your implementation */
+	bool writable;         /* True if user code may write the page. */
+	bool dirty;            /* Written before it was last unmapped. */
+	struct thread *owner;  /* Process whose address space holds the page. */
+	struct list_elem share_elem;  /* Element in `frame->pages'. */
 
 	/* Per-type data are binded into the union.
 	 * Each function automatically detects the current union */
@@ -62,7 +70,19 @@ struct page {
 /* The representation of "frame" */
 struct frame {
 	void *kva;
-	struct page *page;
+	struct page *page;      /* First of `pages'. */
+	uint64_t *pml4;         /* Page table that maps `page'. */
+	struct supplemental_page_table *spt;  /* Table that holds `page'. */
+	struct list pages;      /* Pages sharing the frame. */
+	size_t ref_cnt;         /* Number of pages in `pages'. */
+	bool pinned;            /* Not in the frame table, e.g. while loading. */
+	struct list_elem elem;  /* Element in the frame table. */
+
+	/* Read-only file-backed frames are shared through the text
+	 * cache, under the file's inode and the offset in it. */
+	struct inode *inode;    /* Cache key, or NULL if not cached. */
+	off_t ofs;              /* Cache key. */
+	struct hash_elem cache_elem;  /* Element in the text cache. */
 };
 
 /* The function table for page operations.
@@ -82,11 +102,29 @@ struct page_operations {
 	if ((page)->operations->destroy) (page)->operations->destroy (page)
 
 /* Representation of current process's memory space.
- * We don't want to force you to obey any specific design for this struct.
- * All designs up to you for this. */
+ *
+ * A radix tree with the same shape as the x86-64 page table that
+ * threads/mmu.c walks: four levels of 512-entry nodes, each one
+ * page in size, indexed by the PML4, PDPE, PDX and PTX fields of
+ * a user virtual address.  Entries of the three upper levels
+ * point to the node below; entries of the last level point to
+ * `struct page's.  Nodes exist only for the parts of the address
+ * space that hold pages, and are freed when they empty out.
+ *
+ * The last leaf node visited is remembered, so that runs of
+ * lookups in the same 2 MB region take one memory access. */
 struct supplemental_page_table {
+	void **root;           /* Top-level node, or NULL if empty. */
+	size_t page_cnt;       /* Number of pages in the table. */
+	size_t node_cnt;       /* Number of nodes, including the root. */
+	void **leaf;           /* Last leaf node visited, or NULL. */
+	uint64_t leaf_tag;     /* Virtual address of `leaf' >> PDXSHIFT. */
 };
 
+/* Performs some operation on PAGE, given auxiliary data AUX.
+ * Returns false to stop the walk. */
+typedef bool spt_for_each_func (struct page *page, void *aux);
+
 #include "threads/thread.h"
 void supplemental_page_table_init (struct supplemental_page_table *spt);
 bool supplemental_page_table_copy (struct supplemental_page_table *dst,
@@ -96,8 +134,15 @@ struct page *spt_find_page (struct supplemental_page_table *spt,
 		void *va);
 bool spt_insert_page (struct supplemental_page_table *spt, struct page *page);
 void spt_remove_page (struct supplemental_page_table *spt, struct page *page);
+bool spt_for_each (struct supplemental_page_table *spt, void *start,
+		void *end, spt_for_each_func *func, void *aux);
+void spt_remove_range (struct supplemental_page_table *spt, void *start,
+		void *end);
+
+extern size_t fault_around_pages;
 
 void vm_init (void);
+void vm_print_stats (void);
 bool vm_try_handle_fault (struct intr_frame *f, void *addr, bool user,
 		bool write, bool not_present);
 
@@ -26,6 +26,7 @@ typedef unsigned long elem_type;
    simulates an array of bits. */
 struct bitmap {
 	size_t bit_cnt;     /* Number of bits. */
+	size_t next_fit;    /* Where bitmap_scan_and_flip_next() starts. */
 	elem_type *bits;    /* Elements that represent bits. */
 };
 
@@ -43,6 +44,38 @@ bit_mask (size_t bit_idx) {
 	return (elem_type) 1 << (bit_idx % ELEM_BITS);
 }
 
+/* Returns an elem_type where the bits corresponding to the bits
+   from START up to END, exclusive, are turned on.  START and END
+   must lie in the same element, or END must be at the start of
+   the following one. */
+static inline elem_type
+range_mask (size_t start, size_t end) {
+	size_t cnt = end - start;
+	elem_type mask = cnt < ELEM_BITS ? ((elem_type) 1 << cnt) - 1
+		: (elem_type) -1;
+	return mask << (start % ELEM_BITS);
+}
+
+/* Returns the index just past the last bit, up to END, that
+   shares an element with the bit numbered START. */
+static inline size_t
+elem_end (size_t start, size_t end) {
+	size_t next = (elem_idx (start) + 1) * ELEM_BITS;
+	return next < end ? next : end;
+}
+
+/* Returns the number of bits set to 1 in E. */
+static inline unsigned
+popcount (elem_type e) {
+	/* Add up bits in pairs, then nibbles, then bytes, and then all
+	   the bytes at once.  The kernel is built without POPCNT and
+	   without libgcc's __popcountdi2. */
+	e = e - ((e >> 1) & 0x5555555555555555UL);
+	e = (e & 0x3333333333333333UL) + ((e >> 2) & 0x3333333333333333UL);
+	e = (e + (e >> 4)) & 0x0f0f0f0f0f0f0f0fUL;
+	return (e * 0x0101010101010101UL) >> 56;
+}
+
 /* Returns the number of elements required for BIT_CNT bits. */
 static inline size_t
 elem_cnt (size_t bit_cnt) {
@@ -74,6 +107,7 @@ bitmap_create (size_t bit_cnt) {
 	struct bitmap *b = malloc (sizeof *b);
 	if (b != NULL) {
 		b->bit_cnt = bit_cnt;
+		b->next_fit = 0;
 		b->bits = malloc (byte_cnt (bit_cnt));
 		if (b->bits != NULL || bit_cnt == 0) {
 			bitmap_set_all (b, false);
@@ -94,6 +128,7 @@ bitmap_create_in_buf (size_t bit_cnt, void *block, size_t block_size UNUSED) {
 	ASSERT (block_size >= bitmap_buf_size (bit_cnt));
 
 	b->bit_cnt = bit_cnt;
+	b->next_fit = 0;
 	b->bits = (elem_type *) (b + 1);
 	bitmap_set_all (b, false);
 	return b;
@@ -138,30 +173,38 @@ bitmap_set (struct bitmap *b, size_t idx, bool value) {
 		bitmap_reset (b, idx);
 }
 
-/* Atomically sets the bit numbered BIT_IDX in B to true. */
-void
-bitmap_mark (struct bitmap *b, size_t bit_idx) {
-	size_t idx = elem_idx (bit_idx);
-	elem_type mask = bit_mask (bit_idx);
-
+/* Atomically sets the bits in MASK in element IDX of B to
+   true. */
+static inline void
+elem_mark (struct bitmap *b, size_t idx, elem_type mask) {
 	/* This is equivalent to `b->bits[idx] |= mask' except that it
 	   is guaranteed to be atomic on a uniprocessor machine.  See
 	   the description of the OR instruction in [IA32-v2b]. */
 	asm ("lock orq %1, %0" : "=m" (b->bits[idx]) : "r" (mask) : "cc");
 }
 
-/* Atomically sets the bit numbered BIT_IDX in B to false. */
-void
-bitmap_reset (struct bitmap *b, size_t bit_idx) {
-	size_t idx = elem_idx (bit_idx);
-	elem_type mask = bit_mask (bit_idx);
-
+/* Atomically sets the bits in MASK in element IDX of B to
+   false. */
+static inline void
+elem_reset (struct bitmap *b, size_t idx, elem_type mask) {
 	/* This is equivalent to `b->bits[idx] &= ~mask' except that it
 	   is guaranteed to be atomic on a uniprocessor machine.  See
 	   the description of the AND instruction in [IA32-v2a]. */
 	asm ("lock andq %1, %0" : "=m" (b->bits[idx]) : "r" (~mask) : "cc");
 }
 
+/* Atomically sets the bit numbered BIT_IDX in B to true. */
+void
+bitmap_mark (struct bitmap *b, size_t bit_idx) {
+	elem_mark (b, elem_idx (bit_idx), bit_mask (bit_idx));
+}
+
+/* Atomically sets the bit numbered BIT_IDX in B to false. */
+void
+bitmap_reset (struct bitmap *b, size_t bit_idx) {
+	elem_reset (b, elem_idx (bit_idx), bit_mask (bit_idx));
+}
+
 /* Atomically toggles the bit numbered IDX in B;
    that is, if it is true, makes it false,
    and if it is false, makes it true. */
@@ -194,50 +237,86 @@ bitmap_set_all (struct bitmap *b, bool value) {
 	bitmap_set_multiple (b, 0, bitmap_size (b), value);
 }
 
-/* Sets the CNT bits starting at START in B to VALUE. */
+/* Sets the CNT bits starting at START in B to VALUE.
+   Whole elements are stored at once, and the bits at either end
+   are set atomically. */
 void
 bitmap_set_multiple (struct bitmap *b, size_t start, size_t cnt, bool value) {
+	size_t end = start + cnt;
 	size_t i;
 
 	ASSERT (b != NULL);
 	ASSERT (start <= b->bit_cnt);
 	ASSERT (start + cnt <= b->bit_cnt);
 
-	for (i = 0; i < cnt; i++)
-		bitmap_set (b, start + i, value);
+	for (i = start; i < end; ) {
+		size_t next = elem_end (i, end);
+		elem_type mask = range_mask (i, next);
+
+		if (mask == (elem_type) -1)
+			b->bits[elem_idx (i)] = value ? mask : 0;
+		else if (value)
+			elem_mark (b, elem_idx (i), mask);
+		else
+			elem_reset (b, elem_idx (i), mask);
+		i = next;
+	}
 }
 
 /* Returns the number of bits in B between START and START + CNT,
    exclusive, that are set to VALUE. */
 size_t
 bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value) {
-	size_t i, value_cnt;
+	size_t end = start + cnt;
+	size_t i, one_cnt;
 
 	ASSERT (b != NULL);
 	ASSERT (start <= b->bit_cnt);
 	ASSERT (start + cnt <= b->bit_cnt);
 
-	value_cnt = 0;
-	for (i = 0; i < cnt; i++)
-		if (bitmap_test (b, start + i) == value)
-			value_cnt++;
-	return value_cnt;
+	one_cnt = 0;
+	for (i = start; i < end; ) {
+		size_t next = elem_end (i, end);
+		one_cnt += popcount (b->bits[elem_idx (i)] & range_mask (i, next));
+		i = next;
+	}
+	return value ? one_cnt : cnt - one_cnt;
+}
+
+/* Returns the index of the first bit in B at or after START and
+   before END that is set to VALUE, or END if there is none.
+   Skips a whole element at a time where it can. */
+static size_t
+find_bit (const struct bitmap *b, size_t start, size_t end, bool value) {
+	elem_type flip = value ? 0 : (elem_type) -1;
+	size_t idx, last_idx;
+	elem_type e;
+
+	if (start >= end)
+		return end;
+
+	idx = elem_idx (start);
+	last_idx = elem_idx (end - 1);
+	e = (b->bits[idx] ^ flip) & ((elem_type) -1 << (start % ELEM_BITS));
+	while (e == 0) {
+		if (idx++ == last_idx)
+			return end;
+		e = b->bits[idx] ^ flip;
+	}
+
+	start = idx * ELEM_BITS + __builtin_ctzl (e);
+	return start < end ? start : end;
 }
 
 /* Returns true if any bits in B between START and START + CNT,
    exclusive, are set to VALUE, and false otherwise. */
 bool
 bitmap_contains (const struct bitmap *b, size_t start, size_t cnt, bool value) {
-	size_t i;
-
 	ASSERT (b != NULL);
 	ASSERT (start <= b->bit_cnt);
 	ASSERT (start + cnt <= b->bit_cnt);
 
-	for (i = 0; i < cnt; i++)
-		if (bitmap_test (b, start + i) == value)
-			return true;
-	return false;
+	return find_bit (b, start, start + cnt, value) < start + cnt;
 }
 
 /* Returns true if any bits in B between START and START + CNT,
@@ -263,6 +342,34 @@ bitmap_all (const struct bitmap *b, size_t start, size_t cnt) {
 
 /* Finding set or unset bits. */
 
+/* Finds the first group of CNT consecutive bits in B that are all
+   set to VALUE, at or after START and ending no later than END.
+   Returns the index of its first bit, or BITMAP_ERROR if there is
+   no such group. */
+static size_t
+scan_range (const struct bitmap *b, size_t start, size_t end, size_t cnt,
+		bool value) {
+	size_t i = start;
+
+	if (cnt == 0)
+		return start <= end ? start : BITMAP_ERROR;
+
+	/* Jump from each run of VALUE bits to the next, and return the
+	   first run that is long enough. */
+	while (end - i >= cnt) {
+		size_t run_end;
+
+		i = find_bit (b, i, end - cnt + 1, value);
+		if (end - i < cnt)
+			break;
+		run_end = find_bit (b, i, i + cnt, !value);
+		if (run_end == i + cnt)
+			return i;
+		i = run_end;
+	}
+	return BITMAP_ERROR;
+}
+
 /* Finds and returns the starting index of the first group of CNT
    consecutive bits in B at or after START that are all set to
    VALUE.
@@ -272,14 +379,7 @@ bitmap_scan (const struct bitmap *b, size_t start, size_t cnt, bool value) {
 	ASSERT (b != NULL);
 	ASSERT (start <= b->bit_cnt);
 
-	if (cnt <= b->bit_cnt) {
-		size_t last = b->bit_cnt - cnt;
-		size_t i;
-		for (i = start; i <= last; i++)
-			if (!bitmap_contains (b, i, cnt, !value))
-				return i;
-	}
-	return BITMAP_ERROR;
+	return scan_range (b, start, b->bit_cnt, cnt, value);
 }
 
 /* Finds the first group of CNT consecutive bits in B at or after
@@ -296,6 +396,31 @@ bitmap_scan_and_flip (struct bitmap *b, size_t start, size_t cnt, bool value) {
 		bitmap_set_multiple (b, idx, cnt, !value);
 	return idx;
 }
+
+/* Like bitmap_scan_and_flip(), but starts where the last call to
+   this function on B left off, and goes back to the start of B if
+   it gets to the end without success ("next fit").  Repeated
+   allocations then need not skip over the groups that earlier
+   ones took. */
+size_t
+bitmap_scan_and_flip_next (struct bitmap *b, size_t cnt, bool value) {
+	size_t start = b->next_fit < b->bit_cnt ? b->next_fit : 0;
+	size_t idx;
+
+	/* The groups that start before START but cross it are
+	   found by the second scan. */
+	idx = scan_range (b, start, b->bit_cnt, cnt, value);
+	if (idx == BITMAP_ERROR && start > 0) {
+		size_t end = start + cnt - 1;
+		idx = scan_range (b, 0, end < b->bit_cnt ? end : b->bit_cnt,
+				cnt, value);
+	}
+	if (idx != BITMAP_ERROR) {
+		bitmap_set_multiple (b, idx, cnt, !value);
+		b->next_fit = idx + cnt;
+	}
+	return idx;
+}
 
 /* File input and output. */
 
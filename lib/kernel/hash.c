@@ -18,6 +18,8 @@ static struct hash_elem *find_elem (struct hash *, struct list *,
 static void insert_elem (struct hash *, struct list *, struct hash_elem *);
 static void remove_elem (struct hash *, struct hash_elem *);
 static void rehash (struct hash *);
+static void move_buckets (struct hash *, size_t cnt);
+static struct list *next_bucket (struct hash *, struct list *);
 
 /* Initializes hash table H to compute hash values using HASH and
    compare hash elements using LESS, given auxiliary data AUX. */
@@ -27,6 +29,9 @@ hash_init (struct hash *h,
 	h->elem_cnt = 0;
 	h->bucket_cnt = 4;
 	h->buckets = malloc (sizeof *h->buckets * h->bucket_cnt);
+	h->old_bucket_cnt = 0;
+	h->old_buckets = NULL;
+	h->move_idx = 0;
 	h->hash = hash;
 	h->less = less;
 	h->aux = aux;
@@ -49,11 +54,10 @@ hash_init (struct hash *h,
    whether done in DESTRUCTOR or elsewhere. */
 void
 hash_clear (struct hash *h, hash_action_func *destructor) {
-	size_t i;
-
-	for (i = 0; i < h->bucket_cnt; i++) {
-		struct list *bucket = &h->buckets[i];
+	struct list *bucket;
 
+	for (bucket = next_bucket (h, NULL); bucket != NULL;
+			bucket = next_bucket (h, bucket)) {
 		if (destructor != NULL)
 			while (!list_empty (bucket)) {
 				struct list_elem *list_elem = list_pop_front (bucket);
@@ -64,6 +68,10 @@ hash_clear (struct hash *h, hash_action_func *destructor) {
 		list_init (bucket);
 	}
 
+	free (h->old_buckets);
+	h->old_bucket_cnt = 0;
+	h->old_buckets = NULL;
+	h->move_idx = 0;
 	h->elem_cnt = 0;
 }
 
@@ -81,6 +89,7 @@ void
 hash_destroy (struct hash *h, hash_action_func *destructor) {
 	if (destructor != NULL)
 		hash_clear (h, destructor);
+	free (h->old_buckets);
 	free (h->buckets);
 }
 
@@ -118,7 +127,9 @@ hash_replace (struct hash *h, struct hash_elem *new) {
 }
 
 /* Finds and returns an element equal to E in hash table H, or a
-   null pointer if no equal element exists in the table. */
+   null pointer if no equal element exists in the table.
+   Never moves elements between buckets, so that it can be used
+   during iteration. */
 struct hash_elem *
 hash_find (struct hash *h, struct hash_elem *e) {
 	return find_elem (h, find_bucket (h, e), e);
@@ -149,12 +160,12 @@ hash_delete (struct hash *h, struct hash_elem *e) {
    undefined behavior, whether done from ACTION or elsewhere. */
 void
 hash_apply (struct hash *h, hash_action_func *action) {
-	size_t i;
+	struct list *bucket;
 
 	ASSERT (action != NULL);
 
-	for (i = 0; i < h->bucket_cnt; i++) {
-		struct list *bucket = &h->buckets[i];
+	for (bucket = next_bucket (h, NULL); bucket != NULL;
+			bucket = next_bucket (h, bucket)) {
 		struct list_elem *elem, *next;
 
 		for (elem = list_begin (bucket); elem != list_end (bucket); elem = next) {
@@ -187,7 +198,7 @@ hash_first (struct hash_iterator *i, struct hash *h) {
 	ASSERT (h != NULL);
 
 	i->hash = h;
-	i->bucket = i->hash->buckets;
+	i->bucket = next_bucket (h, NULL);
 	i->elem = list_elem_to_hash_elem (list_head (i->bucket));
 }
 
@@ -205,7 +216,8 @@ hash_next (struct hash_iterator *i) {
 
 	i->elem = list_elem_to_hash_elem (list_next (&i->elem->list_elem));
 	while (i->elem == list_elem_to_hash_elem (list_end (i->bucket))) {
-		if (++i->bucket >= i->hash->buckets + i->hash->bucket_cnt) {
+		i->bucket = next_bucket (i->hash, i->bucket);
+		if (i->bucket == NULL) {
 			i->elem = NULL;
 			break;
 		}
@@ -276,11 +288,34 @@ hash_int (int i) {
 	return hash_bytes (&i, sizeof i);
 }
 
-/* Returns the bucket in H that E belongs in. */
+/* Returns the bucket in H that E belongs in.  While old buckets
+   are being moved, that is E's old bucket unless the old bucket
+   has already been emptied. */
 static struct list *
 find_bucket (struct hash *h, struct hash_elem *e) {
-	size_t bucket_idx = h->hash (e, h->aux) & (h->bucket_cnt - 1);
-	return &h->buckets[bucket_idx];
+	uint64_t hash = h->hash (e, h->aux);
+
+	if (h->old_buckets != NULL) {
+		size_t old_idx = hash & (h->old_bucket_cnt - 1);
+		if (old_idx >= h->move_idx)
+			return &h->old_buckets[old_idx];
+	}
+	return &h->buckets[hash & (h->bucket_cnt - 1)];
+}
+
+/* Returns the bucket of H that follows BUCKET, or the first one
+   if BUCKET is null, or a null pointer after the last one.  The
+   old buckets, if any, come first. */
+static struct list *
+next_bucket (struct hash *h, struct list *bucket) {
+	if (bucket == NULL)
+		return h->old_buckets != NULL ? h->old_buckets : h->buckets;
+	if (h->old_buckets != NULL
+			&& bucket == h->old_buckets + h->old_bucket_cnt - 1)
+		return h->buckets;
+	if (bucket == h->buckets + h->bucket_cnt - 1)
+		return NULL;
+	return bucket + 1;
 }
 
 /* Searches BUCKET in H for a hash element equal to E.  Returns
@@ -314,31 +349,56 @@ is_power_of_2 (size_t x) {
 #define BEST_ELEMS_PER_BUCKET 2 /* Ideal elems/bucket. */
 #define MAX_ELEMS_PER_BUCKET  4 /* Elems/bucket > 4: increase # of buckets. */
 
+/* Number of old buckets emptied by each insertion, replacement,
+   or deletion while the table is being resized.  A resize
+   leaves at least twice as many elements to add or remove
+   before the next one as there are old buckets, so one per call
+   would do; two keeps the old array around for less time. */
+#define MOVE_BUCKETS 2
+
 /* Changes the number of buckets in hash table H to match the
-   ideal.  This function can fail because of an out-of-memory
+   ideal, once the number of elements per bucket strays outside
+   MIN_ELEMS_PER_BUCKET...MAX_ELEMS_PER_BUCKET.
+
+   The elements are not moved all at once.  The old buckets stay
+   in place and this function empties MOVE_BUCKETS of them into
+   the new buckets each time it is called, so that the cost of
+   resizing is spread over many insertions and deletions.
+
+   This function can fail because of an out-of-memory
    condition, but that'll just make hash accesses less efficient;
    we can still continue. */
 static void
 rehash (struct hash *h) {
 	size_t old_bucket_cnt, new_bucket_cnt;
-	struct list *new_buckets, *old_buckets;
+	struct list *new_buckets;
 	size_t i;
 
 	ASSERT (h != NULL);
 
-	/* Save old bucket info for later use. */
-	old_buckets = h->buckets;
+	move_buckets (h, MOVE_BUCKETS);
+
+	/* Leave the bucket count alone while the load is within
+	   bounds, so that a table that hovers around a boundary
+	   does not keep resizing. */
 	old_bucket_cnt = h->bucket_cnt;
+	if (h->elem_cnt <= old_bucket_cnt * MAX_ELEMS_PER_BUCKET
+			&& h->elem_cnt >= old_bucket_cnt * MIN_ELEMS_PER_BUCKET)
+		return;
 
 	/* Calculate the number of buckets to use now.
 	   We want one bucket for about every BEST_ELEMS_PER_BUCKET.
 	   We must have at least four buckets, and the number of
-	   buckets must be a power of 2. */
+	   buckets must be a power of 2.  Round up, so that a table
+	   that has just shrunk is not already close to growing. */
 	new_bucket_cnt = h->elem_cnt / BEST_ELEMS_PER_BUCKET;
 	if (new_bucket_cnt < 4)
 		new_bucket_cnt = 4;
-	while (!is_power_of_2 (new_bucket_cnt))
-		new_bucket_cnt = turn_off_least_1bit (new_bucket_cnt);
+	if (!is_power_of_2 (new_bucket_cnt)) {
+		while (!is_power_of_2 (new_bucket_cnt))
+			new_bucket_cnt = turn_off_least_1bit (new_bucket_cnt);
+		new_bucket_cnt *= 2;
+	}
 
 	/* Don't do anything if the bucket count wouldn't change. */
 	if (new_bucket_cnt == old_bucket_cnt)
@@ -355,27 +415,43 @@ rehash (struct hash *h) {
 	for (i = 0; i < new_bucket_cnt; i++)
 		list_init (&new_buckets[i]);
 
+	/* Finish off an earlier resize that is somehow still going,
+	   then make the current buckets the old ones. */
+	move_buckets (h, SIZE_MAX);
+	h->old_buckets = h->buckets;
+	h->old_bucket_cnt = old_bucket_cnt;
+	h->move_idx = 0;
+
 	/* Install new bucket info. */
 	h->buckets = new_buckets;
 	h->bucket_cnt = new_bucket_cnt;
+}
 
-	/* Move each old element into the appropriate new bucket. */
-	for (i = 0; i < old_bucket_cnt; i++) {
-		struct list *old_bucket;
-		struct list_elem *elem, *next;
+/* Moves the elements of up to CNT old buckets of H into the
+   appropriate new buckets, and frees the old buckets once all of
+   them are empty. */
+static void
+move_buckets (struct hash *h, size_t cnt) {
+	if (h->old_buckets == NULL)
+		return;
 
-		old_bucket = &old_buckets[i];
-		for (elem = list_begin (old_bucket);
-				elem != list_end (old_bucket); elem = next) {
-			struct list *new_bucket
-				= find_bucket (h, list_elem_to_hash_elem (elem));
-			next = list_next (elem);
-			list_remove (elem);
-			list_push_front (new_bucket, elem);
+	for (; cnt > 0 && h->move_idx < h->old_bucket_cnt; cnt--) {
+		struct list *old_bucket = &h->old_buckets[h->move_idx++];
+
+		while (!list_empty (old_bucket)) {
+			struct list_elem *elem = list_pop_front (old_bucket);
+			size_t idx = (h->hash (list_elem_to_hash_elem (elem), h->aux)
+					& (h->bucket_cnt - 1));
+			list_push_front (&h->buckets[idx], elem);
 		}
 	}
 
-	free (old_buckets);
+	if (h->move_idx >= h->old_bucket_cnt) {
+		free (h->old_buckets);
+		h->old_bucket_cnt = 0;
+		h->old_buckets = NULL;
+		h->move_idx = 0;
+	}
 }
 
 /* Inserts E into BUCKET (in hash table H). */
@@ -0,0 +1,185 @@
+/* Pairing heap.
+
+   See pheap.h for basic information.  The implementation follows
+   Fredman, Sedgewick, Sleator and Tarjan, "The Pairing Heap: A
+   New Form of Self-Adjusting Heap", Algorithmica 1 (1986), using
+   the standard two-pass pairing on removal. */
+
+#include "pheap.h"
+#include "../debug.h"
+
+static struct pheap_elem *meld (struct pheap *,
+		struct pheap_elem *, struct pheap_elem *);
+static struct pheap_elem *merge_pairs (struct pheap *, struct pheap_elem *);
+static void detach (struct pheap_elem *);
+
+/* Initializes heap H as an empty heap ordered by LESS, given
+   auxiliary data AUX. */
+void
+pheap_init (struct pheap *h, pheap_less_func *less, void *aux) {
+	ASSERT (h != NULL);
+	ASSERT (less != NULL);
+
+	h->root = NULL;
+	h->elem_cnt = 0;
+	h->less = less;
+	h->aux = aux;
+}
+
+/* Inserts E into heap H. */
+void
+pheap_insert (struct pheap *h, struct pheap_elem *e) {
+	ASSERT (h != NULL);
+	ASSERT (e != NULL);
+
+	e->child = e->next = e->prev = NULL;
+	h->root = h->root != NULL ? meld (h, h->root, e) : e;
+	h->elem_cnt++;
+}
+
+/* Removes E, which must be in heap H, from H. */
+void
+pheap_remove (struct pheap *h, struct pheap_elem *e) {
+	struct pheap_elem *sub;
+
+	ASSERT (h != NULL);
+	ASSERT (e != NULL);
+	ASSERT (h->elem_cnt > 0);
+
+	if (e == h->root) {
+		pheap_pop_max (h);
+		return;
+	}
+
+	detach (e);
+	sub = merge_pairs (h, e->child);
+	if (sub != NULL)
+		h->root = meld (h, h->root, sub);
+	h->elem_cnt--;
+}
+
+/* Restores the heap property after the key of E, which must be
+   in heap H, has changed. */
+void
+pheap_update (struct pheap *h, struct pheap_elem *e) {
+	pheap_remove (h, e);
+	pheap_insert (h, e);
+}
+
+/* Returns the maximum element in heap H, or NULL if H is
+   empty. */
+struct pheap_elem *
+pheap_max (const struct pheap *h) {
+	ASSERT (h != NULL);
+
+	return h->root;
+}
+
+/* Removes and returns the maximum element in heap H, which must
+   not be empty. */
+struct pheap_elem *
+pheap_pop_max (struct pheap *h) {
+	struct pheap_elem *max;
+
+	ASSERT (h != NULL);
+	ASSERT (h->root != NULL);
+
+	max = h->root;
+	h->root = merge_pairs (h, max->child);
+	h->elem_cnt--;
+	return max;
+}
+
+/* Returns the number of elements in heap H. */
+size_t
+pheap_size (const struct pheap *h) {
+	return h->elem_cnt;
+}
+
+/* Returns true if heap H is empty, false otherwise. */
+bool
+pheap_empty (const struct pheap *h) {
+	return h->root == NULL;
+}
+
+/* Melds the trees rooted at A and B, which must not have
+   siblings, and returns the root of the result.  A stays on top
+   when the two are equal. */
+static struct pheap_elem *
+meld (struct pheap *h, struct pheap_elem *a, struct pheap_elem *b) {
+	struct pheap_elem *t;
+
+	if (h->less (a, b, h->aux)) {
+		t = a;
+		a = b;
+		b = t;
+	}
+
+	/* Make B the leftmost child of A. */
+	b->prev = a;
+	b->next = a->child;
+	if (a->child != NULL)
+		a->child->prev = b;
+	a->child = b;
+	a->next = a->prev = NULL;
+	return a;
+}
+
+/* Melds the list of sibling trees starting at FIRST into a
+   single tree and returns its root, or NULL if FIRST is NULL.
+   The first pass melds adjacent pairs from left to right; the
+   second melds the results from right to left. */
+static struct pheap_elem *
+merge_pairs (struct pheap *h, struct pheap_elem *first) {
+	struct pheap_elem *pairs = NULL;
+	struct pheap_elem *root;
+
+	/* First pass.  PAIRS collects the results in reverse order,
+	   linked through their `next' members. */
+	while (first != NULL) {
+		struct pheap_elem *a = first;
+		struct pheap_elem *b = a->next;
+
+		a->prev = NULL;
+		if (b == NULL) {
+			a->next = pairs;
+			pairs = a;
+			break;
+		}
+		first = b->next;
+		a->next = b->next = b->prev = NULL;
+
+		a = meld (h, a, b);
+		a->next = pairs;
+		pairs = a;
+	}
+
+	/* Second pass. */
+	if (pairs == NULL)
+		return NULL;
+	root = pairs;
+	pairs = pairs->next;
+	root->next = NULL;
+	while (pairs != NULL) {
+		struct pheap_elem *next = pairs->next;
+		pairs->next = NULL;
+		root = meld (h, pairs, root);
+		pairs = next;
+	}
+	return root;
+}
+
+/* Unlinks non-root element E, together with its subtree, from
+   its parent and siblings. */
+static void
+detach (struct pheap_elem *e) {
+	ASSERT (e->prev != NULL);
+
+	if (e->prev->child == e)
+		e->prev->child = e->next;
+	else
+		e->prev->next = e->next;
+	if (e->next != NULL)
+		e->next->prev = e->prev;
+	e->next = e->prev = NULL;
+}
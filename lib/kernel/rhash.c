@@ -0,0 +1,453 @@
+/* Open-addressing hash table.
+
+   See rhash.h for basic information. */
+
+#include "rhash.h"
+#include <string.h>
+#include "../debug.h"
+#include "threads/malloc.h"
+
+/* Values of struct rhash_slot's `dist' member with special
+   meaning.  A slot of the old array that has been moved or
+   deleted becomes a tombstone, which lookups must probe past;
+   the current array never contains tombstones. */
+#define SLOT_EMPTY 0
+#define SLOT_TOMB UINT32_MAX
+
+/* The table never has fewer slots than this. */
+#define MIN_SLOT_CNT 8
+
+/* Number of old slots moved into the current array by each
+   insertion, replacement, or deletion.  Growing doubles the
+   slot count at 7/8 load, so the move is always done long
+   before the current array fills up. */
+#define MOVE_CNT 4
+
+static uint32_t slot_hash (struct rhash *, struct hash_elem *);
+static struct rhash_slot *find_slot (struct rhash *, struct rhash_slot *,
+		size_t slot_cnt, uint32_t hash, struct hash_elem *);
+static struct rhash_slot *find_old (struct rhash *, uint32_t,
+		struct hash_elem *);
+static void place_slot (struct rhash *, uint32_t, struct hash_elem *);
+static void remove_slot (struct rhash *, struct rhash_slot *);
+static bool resize (struct rhash *, size_t slot_cnt);
+static void move_slots (struct rhash *, size_t cnt);
+static struct rhash_slot *slot_at (struct rhash *, size_t idx);
+
+/* Initializes hash table H to compute hash values using HASH and
+   compare hash elements using LESS, given auxiliary data AUX. */
+bool
+rhash_init (struct rhash *h,
+		hash_hash_func *hash, hash_less_func *less, void *aux) {
+	h->elem_cnt = 0;
+	h->slot_cnt = MIN_SLOT_CNT;
+	h->slots = calloc (h->slot_cnt, sizeof *h->slots);
+	h->old_slots = NULL;
+	h->old_slot_cnt = 0;
+	h->old_elem_cnt = 0;
+	h->move_idx = 0;
+	h->hash = hash;
+	h->less = less;
+	h->aux = aux;
+
+	return h->slots != NULL;
+}
+
+/* Removes all the elements from H.
+
+   If DESTRUCTOR is non-null, then it is called for each element
+   in the hash.  DESTRUCTOR may, if appropriate, deallocate the
+   memory used by the hash element.  However, modifying hash
+   table H while rhash_clear() is running, using any of the
+   functions rhash_clear(), rhash_destroy(), rhash_insert(),
+   rhash_replace(), or rhash_delete(), yields undefined behavior,
+   whether done in DESTRUCTOR or elsewhere. */
+void
+rhash_clear (struct rhash *h, hash_action_func *destructor) {
+	if (destructor != NULL)
+		rhash_apply (h, destructor);
+
+	free (h->old_slots);
+	h->old_slots = NULL;
+	h->old_slot_cnt = 0;
+	h->old_elem_cnt = 0;
+	h->move_idx = 0;
+
+	memset (h->slots, 0, sizeof *h->slots * h->slot_cnt);
+	h->elem_cnt = 0;
+}
+
+/* Destroys hash table H.
+
+   If DESTRUCTOR is non-null, then it is first called for each
+   element in the hash.  DESTRUCTOR may, if appropriate,
+   deallocate the memory used by the hash element.  However,
+   modifying hash table H while rhash_clear() is running, using
+   any of the functions rhash_clear(), rhash_destroy(),
+   rhash_insert(), rhash_replace(), or rhash_delete(), yields
+   undefined behavior, whether done in DESTRUCTOR or
+   elsewhere. */
+void
+rhash_destroy (struct rhash *h, hash_action_func *destructor) {
+	if (destructor != NULL)
+		rhash_apply (h, destructor);
+	free (h->old_slots);
+	free (h->slots);
+}
+
+/* Inserts NEW into hash table H and returns a null pointer, if
+   no equal element is already in the table.
+   If an equal element is already in the table, returns it
+   without inserting NEW.
+   If the table is completely full and memory to grow it cannot
+   be allocated, returns NEW itself without inserting it. */
+struct hash_elem *
+rhash_insert (struct rhash *h, struct hash_elem *new) {
+	uint32_t hash = slot_hash (h, new);
+	struct rhash_slot *s;
+
+	move_slots (h, MOVE_CNT);
+
+	s = find_old (h, hash, new);
+	if (s == NULL)
+		s = find_slot (h, h->slots, h->slot_cnt, hash, new);
+	if (s != NULL)
+		return s->elem;
+
+	/* Grow at 7/8 load.  If that fails, keep going until the
+	   table is actually full. */
+	if ((h->elem_cnt + 1) * 8 > h->slot_cnt * 7
+			&& !resize (h, h->slot_cnt * 2)
+			&& h->elem_cnt >= h->slot_cnt)
+		return new;
+
+	place_slot (h, hash, new);
+	h->elem_cnt++;
+	return NULL;
+}
+
+/* Inserts NEW into hash table H, replacing any equal element
+   already in the table, which is returned.
+   If the table is completely full and memory to grow it cannot
+   be allocated, returns NEW itself without inserting it. */
+struct hash_elem *
+rhash_replace (struct rhash *h, struct hash_elem *new) {
+	uint32_t hash = slot_hash (h, new);
+	struct rhash_slot *s;
+
+	move_slots (h, MOVE_CNT);
+
+	s = find_old (h, hash, new);
+	if (s == NULL)
+		s = find_slot (h, h->slots, h->slot_cnt, hash, new);
+	if (s != NULL) {
+		/* Equal elements hash equally, so NEW can simply take
+		   the old element's place. */
+		struct hash_elem *old = s->elem;
+		s->elem = new;
+		return old;
+	}
+
+	return rhash_insert (h, new);
+}
+
+/* Finds and returns an element equal to E in hash table H, or a
+   null pointer if no equal element exists in the table.
+   Never changes the table, so it does not invalidate
+   iterators. */
+struct hash_elem *
+rhash_find (struct rhash *h, struct hash_elem *e) {
+	uint32_t hash = slot_hash (h, e);
+	struct rhash_slot *s;
+
+	s = find_old (h, hash, e);
+	if (s == NULL)
+		s = find_slot (h, h->slots, h->slot_cnt, hash, e);
+	return s != NULL ? s->elem : NULL;
+}
+
+/* Finds, removes, and returns an element equal to E in hash
+   table H.  Returns a null pointer if no equal element existed
+   in the table.
+
+   If the elements of the hash table are dynamically allocated,
+   or own resources that are, then it is the caller's
+   responsibility to deallocate them. */
+struct hash_elem *
+rhash_delete (struct rhash *h, struct hash_elem *e) {
+	uint32_t hash = slot_hash (h, e);
+	struct hash_elem *found;
+	struct rhash_slot *s;
+
+	move_slots (h, MOVE_CNT);
+
+	s = find_old (h, hash, e);
+	if (s != NULL) {
+		found = s->elem;
+		s->dist = SLOT_TOMB;
+		s->elem = NULL;
+		h->old_elem_cnt--;
+	} else {
+		s = find_slot (h, h->slots, h->slot_cnt, hash, e);
+		if (s == NULL)
+			return NULL;
+		found = s->elem;
+		remove_slot (h, s);
+	}
+	h->elem_cnt--;
+
+	/* Shrink below 1/8 load.  Failure only wastes memory. */
+	if (h->slot_cnt > MIN_SLOT_CNT && h->elem_cnt * 8 < h->slot_cnt)
+		resize (h, h->slot_cnt / 2);
+
+	return found;
+}
+
+/* Calls ACTION for each element in hash table H in arbitrary
+   order.
+   Modifying hash table H while rhash_apply() is running, using
+   any of the functions rhash_clear(), rhash_destroy(),
+   rhash_insert(), rhash_replace(), or rhash_delete(), yields
+   undefined behavior, whether done from ACTION or elsewhere. */
+void
+rhash_apply (struct rhash *h, hash_action_func *action) {
+	size_t i;
+
+	ASSERT (action != NULL);
+
+	for (i = 0; i < h->old_slot_cnt; i++)
+		if (h->old_slots[i].elem != NULL)
+			action (h->old_slots[i].elem, h->aux);
+	for (i = 0; i < h->slot_cnt; i++)
+		if (h->slots[i].elem != NULL)
+			action (h->slots[i].elem, h->aux);
+}
+
+/* Initializes I for iterating hash table H.
+
+   Iteration idiom:
+
+   struct rhash_iterator i;
+
+   rhash_first (&i, h);
+   while (rhash_next (&i))
+   {
+   struct foo *f = hash_entry (rhash_cur (&i), struct foo, elem);
+   ...do something with f...
+   }
+
+   Modifying hash table H during iteration, using any of the
+   functions rhash_clear(), rhash_destroy(), rhash_insert(),
+   rhash_replace(), or rhash_delete(), invalidates all
+   iterators. */
+void
+rhash_first (struct rhash_iterator *i, struct rhash *h) {
+	ASSERT (i != NULL);
+	ASSERT (h != NULL);
+
+	i->hash = h;
+	i->idx = 0;
+	i->elem = NULL;
+}
+
+/* Advances I to the next element in the hash table and returns
+   it.  Returns a null pointer if no elements are left.  Elements
+   are returned in arbitrary order.
+
+   Modifying a hash table H during iteration, using any of the
+   functions rhash_clear(), rhash_destroy(), rhash_insert(),
+   rhash_replace(), or rhash_delete(), invalidates all
+   iterators. */
+struct hash_elem *
+rhash_next (struct rhash_iterator *i) {
+	struct rhash_slot *s;
+
+	ASSERT (i != NULL);
+
+	i->elem = NULL;
+	while ((s = slot_at (i->hash, i->idx)) != NULL) {
+		i->idx++;
+		if (s->elem != NULL) {
+			i->elem = s->elem;
+			break;
+		}
+	}
+
+	return i->elem;
+}
+
+/* Returns the current element in the hash table iteration, or a
+   null pointer at the end of the table.  Undefined behavior
+   after calling rhash_first() but before rhash_next(). */
+struct hash_elem *
+rhash_cur (struct rhash_iterator *i) {
+	return i->elem;
+}
+
+/* Returns the number of elements in H. */
+size_t
+rhash_size (struct rhash *h) {
+	return h->elem_cnt;
+}
+
+/* Returns true if H contains no elements, false otherwise. */
+bool
+rhash_empty (struct rhash *h) {
+	return h->elem_cnt == 0;
+}
+
+/* Returns the hash value that H keeps in E's slot. */
+static uint32_t
+slot_hash (struct rhash *h, struct hash_elem *e) {
+	return h->hash (e, h->aux);
+}
+
+/* Searches the SLOT_CNT SLOTS of H for an element equal to E,
+   whose hash is HASH.  Returns its slot if found or a null
+   pointer otherwise.
+
+   Robin Hood insertion keeps every element at least as far from
+   its home slot as the elements before it on the same probe
+   sequence, so the search can stop at the first element that is
+   closer to home than E would be. */
+static struct rhash_slot *
+find_slot (struct rhash *h, struct rhash_slot *slots, size_t slot_cnt,
+		uint32_t hash, struct hash_elem *e) {
+	size_t mask = slot_cnt - 1;
+	size_t idx = hash & mask;
+	uint32_t dist;
+
+	for (dist = 1; dist <= slot_cnt; dist++, idx = (idx + 1) & mask) {
+		struct rhash_slot *s = &slots[idx];
+
+		if (s->dist == SLOT_EMPTY)
+			break;
+		if (s->dist == SLOT_TOMB)
+			continue;
+		if (s->dist < dist)
+			break;
+		if (s->hash == hash
+				&& !h->less (s->elem, e, h->aux) && !h->less (e, s->elem, h->aux))
+			return s;
+	}
+	return NULL;
+}
+
+/* Searches the old slots of H, if any, for an element equal to
+   E, whose hash is HASH. */
+static struct rhash_slot *
+find_old (struct rhash *h, uint32_t hash, struct hash_elem *e) {
+	if (h->old_elem_cnt == 0)
+		return NULL;
+	return find_slot (h, h->old_slots, h->old_slot_cnt, hash, e);
+}
+
+/* Puts E, whose hash is HASH, into the current slots of H, which
+   must have a free slot.  Does not update the element count. */
+static void
+place_slot (struct rhash *h, uint32_t hash, struct hash_elem *e) {
+	size_t mask = h->slot_cnt - 1;
+	size_t idx = hash & mask;
+	struct rhash_slot new = { .hash = hash, .dist = 1, .elem = e };
+
+	for (;; idx = (idx + 1) & mask, new.dist++) {
+		struct rhash_slot *s = &h->slots[idx];
+
+		if (s->dist == SLOT_EMPTY) {
+			*s = new;
+			return;
+		}
+
+		/* Take the place of an element closer to its home than
+		   we are to ours, and carry on inserting that one. */
+		if (s->dist < new.dist) {
+			struct rhash_slot tmp = *s;
+			*s = new;
+			new = tmp;
+		}
+	}
+}
+
+/* Removes the element in S, one of the current slots of H, and
+   shifts the elements after it back by one slot until one is
+   already home.  Does not update the element count. */
+static void
+remove_slot (struct rhash *h, struct rhash_slot *s) {
+	size_t mask = h->slot_cnt - 1;
+	size_t idx = s - h->slots;
+
+	for (;;) {
+		size_t next = (idx + 1) & mask;
+
+		if (h->slots[next].dist <= 1)
+			break;
+		h->slots[idx] = h->slots[next];
+		h->slots[idx].dist--;
+		idx = next;
+	}
+	h->slots[idx].dist = SLOT_EMPTY;
+	h->slots[idx].elem = NULL;
+}
+
+/* Switches H to a fresh array of SLOT_CNT slots.  The current
+   slots become the old slots, which later insertions and
+   deletions move over a few at a time.  Finishes moving any
+   earlier old slots first.  Returns true if successful, false
+   on out of memory, in which case H is usable but unchanged. */
+static bool
+resize (struct rhash *h, size_t slot_cnt) {
+	struct rhash_slot *slots;
+
+	ASSERT (slot_cnt >= MIN_SLOT_CNT);
+	ASSERT ((slot_cnt & (slot_cnt - 1)) == 0);
+
+	move_slots (h, SIZE_MAX);
+
+	slots = calloc (slot_cnt, sizeof *slots);
+	if (slots == NULL)
+		return false;
+
+	h->old_slots = h->slots;
+	h->old_slot_cnt = h->slot_cnt;
+	h->old_elem_cnt = h->elem_cnt;
+	h->move_idx = 0;
+	h->slots = slots;
+	h->slot_cnt = slot_cnt;
+	return true;
+}
+
+/* Moves up to CNT old slots of H into its current slots, and
+   frees the old slots once all of them are moved. */
+static void
+move_slots (struct rhash *h, size_t cnt) {
+	if (h->old_slots == NULL)
+		return;
+
+	while (cnt-- > 0 && h->old_elem_cnt > 0) {
+		struct rhash_slot *s = &h->old_slots[h->move_idx++];
+
+		if (s->elem != NULL) {
+			place_slot (h, s->hash, s->elem);
+			s->dist = SLOT_TOMB;
+			s->elem = NULL;
+			h->old_elem_cnt--;
+		}
+	}
+
+	if (h->old_elem_cnt == 0) {
+		free (h->old_slots);
+		h->old_slots = NULL;
+		h->old_slot_cnt = 0;
+		h->move_idx = 0;
+	}
+}
+
+/* Returns slot IDX of H, counting the old slots first, or a
+   null pointer if IDX is past the last slot. */
+static struct rhash_slot *
+slot_at (struct rhash *h, size_t idx) {
+	if (idx < h->old_slot_cnt)
+		return &h->old_slots[idx];
+	idx -= h->old_slot_cnt;
+	return idx < h->slot_cnt ? &h->slots[idx] : NULL;
+}
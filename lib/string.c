@@ -1,5 +1,37 @@
 #include <string.h>
 #include <debug.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/* The block functions below move 8 or 16 bytes at a time through
+   `word', whatever the alignment of their arguments, which x86-64
+   allows at little or no cost.  Blocks of at least REP_MIN bytes
+   are left to the string instructions, which CPUs with "enhanced
+   REP MOVSB/STOSB" (ERMS) run a cache line at a time; below that
+   their startup cost dominates. */
+typedef uint64_t word __attribute__ ((may_alias, aligned (1)));
+#define REP_MIN 256
+
+/* The string functions below read a word at a time too, which
+   may read past the null terminator.  That is safe as long as the
+   whole word lies in the same page as the terminator, which always
+   holds for an aligned word, and for an unaligned one that does
+   not cross a PAGE_SIZE boundary. */
+#define PAGE_SIZE 4096
+
+/* Returns true if any byte of W is zero.  Subtracting 1 from each
+   byte borrows into its top bit only if the byte was zero or
+   already had its top bit set, and `& ~W' rules out the latter. */
+static inline bool
+has_zero (uint64_t w) {
+	return ((w - 0x0101010101010101ULL) & ~w & 0x8080808080808080ULL) != 0;
+}
+
+/* Returns true if P is aligned for reading a word. */
+static inline bool
+word_aligned (const void *p) {
+	return (uintptr_t) p % sizeof (word) == 0;
+}
 
 /* Copies SIZE bytes from SRC to DST, which must not overlap.
    Returns DST. */
@@ -11,6 +43,24 @@ memcpy (void *dst_, const void *src_, size_t size) {
 	ASSERT (dst != NULL || size == 0);
 	ASSERT (src != NULL || size == 0);
 
+	if (size >= REP_MIN) {
+		asm volatile ("rep movsb"
+				: "+D" (dst), "+S" (src), "+c" (size) : : "memory");
+		return dst_;
+	}
+
+	/* Both loads come before both stores, so that memmove() can
+	   also use this loop when DST is below SRC. */
+	for (; size >= 16; size -= 16, dst += 16, src += 16) {
+		word w0 = ((const word *) src)[0];
+		word w1 = ((const word *) src)[1];
+		((word *) dst)[0] = w0;
+		((word *) dst)[1] = w1;
+	}
+	if (size >= 8) {
+		*(word *) dst = *(const word *) src;
+		size -= 8, dst += 8, src += 8;
+	}
 	while (size-- > 0)
 		*dst++ = *src++;
 
@@ -27,17 +77,25 @@ memmove (void *dst_, const void *src_, size_t size) {
 	ASSERT (dst != NULL || size == 0);
 	ASSERT (src != NULL || size == 0);
 
-	if (dst < src) {
-		while (size-- > 0)
-			*dst++ = *src++;
-	} else {
-		dst += size;
-		src += size;
-		while (size-- > 0)
-			*--dst = *--src;
+	/* Copying forward is safe unless DST overlaps the end of SRC.
+	   REP MOVSB copies forward one byte at a time as far as the
+	   result is concerned, whatever it does inside. */
+	if (dst <= src || dst >= src + size)
+		return memcpy (dst_, src_, size);
+
+	/* Copy backward, a word at a time.  The direction flag stays
+	   clear, since interrupt handlers rely on it. */
+	dst += size;
+	src += size;
+	for (; size >= 8; size -= 8) {
+		dst -= 8;
+		src -= 8;
+		*(word *) dst = *(const word *) src;
 	}
+	while (size-- > 0)
+		*--dst = *--src;
 
-	return dst;
+	return dst_;
 }
 
 /* Find the first differing byte in the two blocks of SIZE bytes
@@ -52,6 +110,16 @@ memcmp (const void *a_, const void *b_, size_t size) {
 	ASSERT (a != NULL || size == 0);
 	ASSERT (b != NULL || size == 0);
 
+	/* Skip equal words.  Swapping the bytes of the first unequal
+	   pair makes the byte at the lowest address the most
+	   significant, so that comparing the words compares the first
+	   differing bytes. */
+	for (; size >= 8; size -= 8, a += 8, b += 8) {
+		uint64_t wa = *(const word *) a;
+		uint64_t wb = *(const word *) b;
+		if (wa != wb)
+			return __builtin_bswap64 (wa) > __builtin_bswap64 (wb) ? +1 : -1;
+	}
 	for (; size-- > 0; a++, b++)
 		if (*a != *b)
 			return *a > *b ? +1 : -1;
@@ -71,6 +139,29 @@ strcmp (const char *a_, const char *b_) {
 	ASSERT (a != NULL);
 	ASSERT (b != NULL);
 
+	/* Compare a byte at a time until A is aligned, then a word at a
+	   time until the words differ or A's word holds its null
+	   terminator.  A word read from B is only unaligned if B's
+	   alignment differs from A's, in which case it is read a byte
+	   at a time where it would cross a page. */
+	for (; !word_aligned (a); a++, b++)
+		if (*a == '\0' || *a != *b)
+			return *a < *b ? -1 : *a > *b;
+	for (;;) {
+		if ((uintptr_t) b % PAGE_SIZE > PAGE_SIZE - sizeof (word)) {
+			size_t i;
+
+			for (i = 0; i < sizeof (word); i++, a++, b++)
+				if (*a == '\0' || *a != *b)
+					return *a < *b ? -1 : *a > *b;
+		} else if (*(const word *) a == *(const word *) b
+				&& !has_zero (*(const word *) a)) {
+			a += sizeof (word);
+			b += sizeof (word);
+		} else
+			break;
+	}
+
 	while (*a != '\0' && *a == *b) {
 		a++;
 		b++;
@@ -103,9 +194,24 @@ memchr (const void *block_, int ch_, size_t size) {
 char *
 strchr (const char *string, int c_) {
 	char c = c_;
+	uint64_t pattern = (unsigned char) c * 0x0101010101010101ULL;
 
 	ASSERT (string);
 
+	/* Skip, a word at a time, the aligned words that contain
+	   neither C nor the null terminator. */
+	for (; !word_aligned (string); string++)
+		if (*string == c)
+			return (char *) string;
+		else if (*string == '\0')
+			return NULL;
+	for (;;) {
+		uint64_t w = *(const word *) string;
+		if (has_zero (w) || has_zero (w ^ pattern))
+			break;
+		string += sizeof (word);
+	}
+
 	for (;;)
 		if (*string == c)
 			return (char *) string;
@@ -257,9 +363,26 @@ strtok_r (char *s, const char *delimiters, char **save_ptr) {
 void *
 memset (void *dst_, int value, size_t size) {
 	unsigned char *dst = dst_;
+	uint64_t pattern;
 
 	ASSERT (dst != NULL || size == 0);
 
+	if (size >= REP_MIN) {
+		asm volatile ("rep stosb"
+				: "+D" (dst), "+c" (size) : "a" (value) : "memory");
+		return dst_;
+	}
+
+	/* VALUE's low byte, repeated in each byte of a word. */
+	pattern = (unsigned char) value * 0x0101010101010101ULL;
+	for (; size >= 16; size -= 16, dst += 16) {
+		((word *) dst)[0] = pattern;
+		((word *) dst)[1] = pattern;
+	}
+	if (size >= 8) {
+		*(word *) dst = pattern;
+		size -= 8, dst += 8;
+	}
 	while (size-- > 0)
 		*dst++ = value;
 
@@ -273,7 +396,15 @@ strlen (const char *string) {
 
 	ASSERT (string);
 
-	for (p = string; *p != '\0'; p++)
+	/* Step to an aligned word, then skip words without a null
+	   byte. */
+	for (p = string; !word_aligned (p); p++)
+		if (*p == '\0')
+			return p - string;
+	while (!has_zero (*(const word *) p))
+		p += sizeof (word);
+
+	for (; *p != '\0'; p++)
 		continue;
 	return p - string;
 }
@@ -284,7 +415,15 @@ size_t
 strnlen (const char *string, size_t maxlen) {
 	size_t length;
 
-	for (length = 0; string[length] != '\0' && length < maxlen; length++)
+	for (length = 0; length < maxlen && !word_aligned (string + length);
+			length++)
+		if (string[length] == '\0')
+			return length;
+	while (maxlen - length >= sizeof (word)
+			&& !has_zero (*(const word *) (string + length)))
+		length += sizeof (word);
+
+	for (; length < maxlen && string[length] != '\0'; length++)
 		continue;
 	return length;
 }
@@ -0,0 +1,193 @@
+/* Test program for lib/kernel/bitmap.c.
+
+   Checks counting, searching and setting groups of bits against
+   a plain array of bools, for bitmaps of many sizes and at every
+   alignment, and then times bitmap_scan() and bitmap_count() on a
+   bitmap of 1M bits against a bit-at-a-time loop.
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <bitmap.h>
+#include <debug.h>
+#include <random.h>
+#include <stdio.h>
+#include "threads/test.h"
+#include "intrinsic.h"
+
+/* Largest bitmap to check against an array of bools. */
+#define MAX_BITS 700
+
+/* Size of the bitmap for timing. */
+#define BENCH_BITS (1024 * 1024)
+
+static bool ref[MAX_BITS];
+
+static void check_bitmap (size_t bit_cnt, int density);
+static size_t ref_scan (size_t bit_cnt, size_t start, size_t cnt, bool);
+static void bench (void);
+static size_t slow_scan (const struct bitmap *, size_t cnt, bool);
+static size_t slow_count (const struct bitmap *, bool);
+
+/* Test the bitmap implementation. */
+void
+test (void) 
+{
+  size_t bit_cnt;
+
+  printf ("testing various size bitmaps:");
+  for (bit_cnt = 0; bit_cnt < MAX_BITS; bit_cnt = bit_cnt * 4 / 3 + 1)
+    {
+      int density;
+
+      printf (" %zu", bit_cnt);
+      for (density = 0; density <= 100; density += 10)
+        check_bitmap (bit_cnt, density);
+    }
+  printf (" done\n");
+
+  bench ();
+  printf ("bitmap: PASS\n");
+}
+
+/* Fills a bitmap of BIT_CNT bits with DENSITY percent of true
+   bits, then checks and changes groups of bits in it, starting
+   at every index. */
+static void
+check_bitmap (size_t bit_cnt, int density) 
+{
+  struct bitmap *b = bitmap_create (bit_cnt);
+  size_t start, i;
+
+  ASSERT (b != NULL);
+  for (i = 0; i < bit_cnt; i++)
+    {
+      ref[i] = (int) (random_ulong () % 100) < density;
+      bitmap_set (b, i, ref[i]);
+    }
+
+  for (start = 0; start <= bit_cnt; start++)
+    {
+      size_t cnt = random_ulong () % (bit_cnt - start + 1);
+      bool value = random_ulong () % 2;
+      size_t value_cnt = 0;
+
+      for (i = start; i < start + cnt; i++)
+        value_cnt += ref[i] == value;
+      ASSERT (bitmap_count (b, start, cnt, value) == value_cnt);
+      ASSERT (bitmap_contains (b, start, cnt, value) == (value_cnt > 0));
+      ASSERT (bitmap_scan (b, start, cnt % 9, value)
+              == ref_scan (bit_cnt, start, cnt % 9, value));
+
+      if (random_ulong () % 4 == 0)
+        {
+          bitmap_set_multiple (b, start, cnt, value);
+          for (i = start; i < start + cnt; i++)
+            ref[i] = value;
+        }
+      if (random_ulong () % 4 == 0)
+        {
+          size_t idx = bitmap_scan_and_flip_next (b, cnt % 5, value);
+
+          if (idx == BITMAP_ERROR)
+            {
+              ASSERT (ref_scan (bit_cnt, 0, cnt % 5, value) == BITMAP_ERROR);
+            }
+          else
+            for (i = idx; i < idx + cnt % 5; i++)
+              {
+                ASSERT (ref[i] == value);
+                ref[i] = !value;
+              }
+        }
+    }
+
+  for (i = 0; i < bit_cnt; i++)
+    ASSERT (bitmap_test (b, i) == ref[i]);
+  bitmap_destroy (b);
+}
+
+/* Returns the first group of CNT bits set to VALUE at or after
+   START in the first BIT_CNT elements of `ref', or BITMAP_ERROR. */
+static size_t
+ref_scan (size_t bit_cnt, size_t start, size_t cnt, bool value) 
+{
+  size_t i, j;
+
+  for (i = start; i + cnt <= bit_cnt; i++)
+    {
+      for (j = 0; j < cnt && ref[i + j] == value; j++)
+        continue;
+      if (j == cnt)
+        return i;
+    }
+  return BITMAP_ERROR;
+}
+
+/* Times searching for a group of free bits in a mostly full
+   bitmap of BENCH_BITS bits, as a nearly full disk's free map
+   would be, and counting its bits. */
+static void
+bench (void) 
+{
+  struct bitmap *b = bitmap_create (BENCH_BITS);
+  uint64_t start, fast, slow;
+  size_t idx;
+
+  ASSERT (b != NULL);
+  bitmap_set_all (b, true);
+  bitmap_set_multiple (b, BENCH_BITS - 100, 8, false);
+
+  start = rdtsc ();
+  idx = bitmap_scan (b, 0, 8, false);
+  fast = rdtsc () - start;
+  start = rdtsc ();
+  ASSERT (slow_scan (b, 8, false) == idx);
+  slow = rdtsc () - start;
+  ASSERT (idx == BENCH_BITS - 100);
+  printf ("scan of %d bits: %llu cycles, bit at a time %llu cycles\n",
+          BENCH_BITS, (unsigned long long) fast, (unsigned long long) slow);
+
+  start = rdtsc ();
+  idx = bitmap_count (b, 0, BENCH_BITS, false);
+  fast = rdtsc () - start;
+  start = rdtsc ();
+  ASSERT (slow_count (b, false) == idx);
+  slow = rdtsc () - start;
+  ASSERT (idx == 8);
+  printf ("count of %d bits: %llu cycles, bit at a time %llu cycles\n",
+          BENCH_BITS, (unsigned long long) fast, (unsigned long long) slow);
+
+  bitmap_destroy (b);
+}
+
+/* Finds CNT bits set to VALUE in B one bit at a time, as
+   bitmap_scan() used to. */
+static size_t
+slow_scan (const struct bitmap *b, size_t cnt, bool value) 
+{
+  size_t i, j;
+
+  for (i = 0; i + cnt <= bitmap_size (b); i++)
+    {
+      for (j = 0; j < cnt && bitmap_test (b, i + j) == value; j++)
+        continue;
+      if (j == cnt)
+        return i;
+    }
+  return BITMAP_ERROR;
+}
+
+/* Counts the bits set to VALUE in B one bit at a time, as
+   bitmap_count() used to. */
+static size_t
+slow_count (const struct bitmap *b, bool value) 
+{
+  size_t i, cnt = 0;
+
+  for (i = 0; i < bitmap_size (b); i++)
+    cnt += bitmap_test (b, i) == value;
+  return cnt;
+}
@@ -0,0 +1,232 @@
+/* Test program for lib/kernel/hash.c.
+
+   Runs random insertions, replacements, lookups and deletions
+   against a plain array that records which keys are present,
+   checking the table's contents by iteration along the way, so
+   that growing and shrinking happen with old buckets still being
+   moved.  Then reports the slowest single insertion while
+   filling a large table.
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <debug.h>
+#include <hash.h>
+#include <random.h>
+#include <stdio.h>
+#include "threads/malloc.h"
+#include "threads/test.h"
+#include "intrinsic.h"
+
+/* Keys are drawn from 0...MAX_KEY - 1. */
+#define MAX_KEY 4096
+
+/* Number of random operations per round. */
+#define OP_CNT 20000
+
+/* Number of elements for timing. */
+#define BENCH_CNT 50000
+
+/* A hash table element. */
+struct value 
+  {
+    struct hash_elem elem;      /* Hash element. */
+    int key;                    /* Item key. */
+  };
+
+static struct value values[MAX_KEY];
+static struct value copies[MAX_KEY];
+static bool present[MAX_KEY];
+static struct value *current[MAX_KEY];
+
+static hash_hash_func value_hash;
+static hash_less_func value_less;
+static void check_round (int max_key);
+static void verify (struct hash *, int max_key, size_t cnt);
+static void bench (void);
+
+/* Test the hash table implementation. */
+void
+test (void) 
+{
+  int max_key;
+
+  printf ("testing random operations:");
+  for (max_key = 1; max_key <= MAX_KEY; max_key *= 4)
+    {
+      printf (" %d", max_key);
+      check_round (max_key);
+    }
+  printf (" done\n");
+
+  bench ();
+}
+
+/* Runs OP_CNT random operations on keys below MAX_KEY. */
+static void
+check_round (int max_key) 
+{
+  struct hash h;
+  size_t cnt = 0;
+  int i;
+
+  ASSERT (hash_init (&h, value_hash, value_less, NULL));
+  for (i = 0; i < max_key; i++)
+    {
+      values[i].key = copies[i].key = i;
+      present[i] = false;
+      current[i] = NULL;
+    }
+
+  for (i = 0; i < OP_CNT; i++)
+    {
+      /* Favor insertions during the first half of the round and
+         deletions during the second, so the table both grows
+         and shrinks. */
+      int bias = i < OP_CNT / 2 ? 0 : 2;
+      int key = random_ulong () % max_key;
+      struct value *v = random_ulong () % 2 ? &values[key] : &copies[key];
+      struct hash_elem *e;
+
+      switch ((random_ulong () % 4 + bias) % 5)
+        {
+        case 0:
+        case 1:
+          e = hash_insert (&h, &v->elem);
+          if (present[key])
+            {
+              ASSERT (e == &current[key]->elem);
+            }
+          else
+            {
+              ASSERT (e == NULL);
+              present[key] = true;
+              current[key] = v;
+              cnt++;
+            }
+          break;
+
+        case 2:
+          e = hash_replace (&h, &v->elem);
+          if (present[key])
+            {
+              ASSERT (e == &current[key]->elem);
+            }
+          else
+            {
+              ASSERT (e == NULL);
+              present[key] = true;
+              cnt++;
+            }
+          current[key] = v;
+          break;
+
+        case 3:
+        case 4:
+          e = hash_delete (&h, &v->elem);
+          if (present[key])
+            {
+              ASSERT (e == &current[key]->elem);
+              present[key] = false;
+              current[key] = NULL;
+              cnt--;
+            }
+          else
+            ASSERT (e == NULL);
+          break;
+        }
+
+      if (i % 97 == 0)
+        verify (&h, max_key, cnt);
+    }
+  verify (&h, max_key, cnt);
+
+  hash_clear (&h, NULL);
+  verify (&h, 0, 0);
+  hash_destroy (&h, NULL);
+}
+
+/* Checks that H holds exactly the CNT current values with keys
+   below MAX_KEY, by lookup and by iteration. */
+static void
+verify (struct hash *h, int max_key, size_t cnt) 
+{
+  struct hash_iterator i;
+  size_t seen = 0;
+  int key;
+
+  ASSERT (hash_size (h) == cnt);
+  ASSERT (hash_empty (h) == (cnt == 0));
+
+  for (key = 0; key < max_key; key++)
+    {
+      struct hash_elem *e = hash_find (h, &copies[key].elem);
+      ASSERT (e == (present[key] ? &current[key]->elem : NULL));
+    }
+
+  hash_first (&i, h);
+  while (hash_next (&i))
+    {
+      struct value *v = hash_entry (hash_cur (&i), struct value, elem);
+      ASSERT (v->key >= 0 && v->key < max_key);
+      ASSERT (current[v->key] == v);
+      ASSERT (hash_find (h, &copies[v->key].elem) == &v->elem);
+      seen++;
+    }
+  ASSERT (hash_cur (&i) == NULL);
+  ASSERT (seen == cnt);
+}
+
+/* Inserts BENCH_CNT elements and reports the average and the
+   largest number of cycles taken by a single insertion. */
+static void
+bench (void) 
+{
+  struct value *bench_values = malloc (sizeof *bench_values * BENCH_CNT);
+  struct hash h;
+  uint64_t total = 0, worst = 0;
+  int i;
+
+  ASSERT (bench_values != NULL);
+  ASSERT (hash_init (&h, value_hash, value_less, NULL));
+  for (i = 0; i < BENCH_CNT; i++)
+    {
+      uint64_t start, cycles;
+
+      bench_values[i].key = i * 7919;
+      start = rdtsc ();
+      ASSERT (hash_insert (&h, &bench_values[i].elem) == NULL);
+      cycles = rdtsc () - start;
+
+      total += cycles;
+      if (cycles > worst)
+        worst = cycles;
+    }
+
+  printf ("%d insertions: %llu cycles each, %llu at worst\n",
+          BENCH_CNT, (unsigned long long) (total / BENCH_CNT),
+          (unsigned long long) worst);
+
+  hash_destroy (&h, NULL);
+  free (bench_values);
+}
+
+/* Returns a hash of V's key. */
+static uint64_t
+value_hash (const struct hash_elem *e, void *aux UNUSED) 
+{
+  const struct value *v = hash_entry (e, struct value, elem);
+  return hash_int (v->key);
+}
+
+/* Returns true if A's key is less than B's. */
+static bool
+value_less (const struct hash_elem *a, const struct hash_elem *b,
+            void *aux UNUSED) 
+{
+  const struct value *va = hash_entry (a, struct value, elem);
+  const struct value *vb = hash_entry (b, struct value, elem);
+  return va->key < vb->key;
+}
@@ -0,0 +1,214 @@
+/* Benchmark for the supplemental page table in vm/vm.c.
+
+   Builds the address space of two of the VM tests, page-linear
+   and page-merge-par, in the radix-tree supplemental page table
+   of the running thread and in a table of the same pages kept in
+   a hash table from lib/kernel/hash.c.  Then replays the order in
+   which each test first touches its pages against both, and
+   reports the cycles per lookup and the memory each one uses.
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <debug.h>
+#include <hash.h>
+#include <stdio.h>
+#include "threads/malloc.h"
+#include "threads/test.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "vm/vm.h"
+#include "intrinsic.h"
+
+/* Where the pages of the modeled programs are. */
+#define CODE_BASE ((uint8_t *) 0x400000)
+#define CODE_PAGES 16
+#define DATA_BASE ((uint8_t *) 0x800000)
+#define STACK_PAGE ((uint8_t *) USER_STACK - PGSIZE)
+
+/* page-linear: one 2 MB buffer, written and then read in order. */
+#define LINEAR_PAGES 512
+#define LINEAR_PASSES 2
+
+/* page-merge-par: CHUNK_CNT chunks of CHUNK_PAGES pages in one
+   buffer, merged into a second buffer of the same size. */
+#define CHUNK_CNT 8
+#define CHUNK_PAGES 32
+#define MERGE_PAGES (CHUNK_CNT * CHUNK_PAGES)
+
+/* Number of times each access sequence is replayed. */
+#define REPEAT_CNT 20
+
+/* An entry of the hash-based table. */
+struct hash_page
+  {
+    struct hash_elem elem;      /* Hash element. */
+    struct page *page;          /* The page. */
+  };
+
+static hash_hash_func hash_page_hash;
+static hash_less_func hash_page_less;
+static spt_for_each_func add_hash_page;
+static hash_action_func free_hash_page;
+
+static void run (const char *name, size_t data_pages,
+                 void *(*access) (size_t));
+static void map_pages (uint8_t *base, size_t page_cnt);
+static void *linear_access (size_t);
+static void *merge_access (size_t);
+static struct page *hash_find_page (struct hash *, void *va);
+
+/* Benchmark the supplemental page table. */
+void
+test (void) 
+{
+  run ("page-linear", LINEAR_PAGES, linear_access);
+  run ("page-merge-par", MERGE_PAGES * 2, merge_access);
+}
+
+/* Maps the code, a stack page and DATA_PAGES data pages, then
+   times ACCESS's sequence of lookups in both tables.  ACCESS
+   returns a null pointer past the end of its sequence. */
+static void
+run (const char *name, size_t data_pages, void *(*access) (size_t)) 
+{
+  struct supplemental_page_table *spt = &thread_current ()->spt;
+  uint64_t start, radix_cycles, hash_cycles;
+  size_t lookup_cnt = 0, hash_mem;
+  struct hash table;
+  void *va;
+  size_t i;
+  int r;
+
+  supplemental_page_table_init (spt);
+  map_pages (CODE_BASE, CODE_PAGES);
+  map_pages (DATA_BASE, data_pages);
+  map_pages (STACK_PAGE, 1);
+
+  ASSERT (hash_init (&table, hash_page_hash, hash_page_less, NULL));
+  ASSERT (spt_for_each (spt, NULL, (void *) KERN_BASE, add_hash_page,
+                        &table));
+  ASSERT (hash_size (&table) == spt->page_cnt);
+
+  for (i = 0; (va = access (i)) != NULL; i++)
+    {
+      ASSERT (spt_find_page (spt, va) != NULL);
+      ASSERT (hash_find_page (&table, va) == spt_find_page (spt, va));
+      lookup_cnt++;
+    }
+
+  start = rdtsc ();
+  for (r = 0; r < REPEAT_CNT; r++)
+    for (i = 0; (va = access (i)) != NULL; i++)
+      spt_find_page (spt, va);
+  radix_cycles = rdtsc () - start;
+
+  start = rdtsc ();
+  for (r = 0; r < REPEAT_CNT; r++)
+    for (i = 0; (va = access (i)) != NULL; i++)
+      hash_find_page (&table, va);
+  hash_cycles = rdtsc () - start;
+
+  hash_mem = (hash_size (&table) * sizeof (struct hash_page)
+                + table.bucket_cnt * sizeof (struct list));
+  printf ("%s: %zu pages, %zu lookups\n", name, spt->page_cnt, lookup_cnt);
+  printf ("  radix: %llu cycles/lookup, %zu bytes in %zu nodes\n",
+          (unsigned long long) (radix_cycles / (lookup_cnt * REPEAT_CNT)),
+          spt->node_cnt * PGSIZE, spt->node_cnt);
+  printf ("  hash:  %llu cycles/lookup, %zu bytes\n",
+          (unsigned long long) (hash_cycles / (lookup_cnt * REPEAT_CNT)),
+          hash_mem);
+
+  hash_destroy (&table, free_hash_page);
+  supplemental_page_table_kill (spt);
+  ASSERT (spt->node_cnt == 0);
+}
+
+/* Adds PAGE_CNT anonymous pages starting at BASE to the current
+   thread's supplemental page table. */
+static void
+map_pages (uint8_t *base, size_t page_cnt) 
+{
+  size_t i;
+
+  for (i = 0; i < page_cnt; i++)
+    ASSERT (vm_alloc_page (VM_ANON, base + i * PGSIZE, true));
+}
+
+/* page-linear writes its buffer from start to end, then reads it
+   back the same way. */
+static void *
+linear_access (size_t i) 
+{
+  if (i >= LINEAR_PAGES * LINEAR_PASSES)
+    return NULL;
+  return DATA_BASE + i % LINEAR_PAGES * PGSIZE;
+}
+
+/* page-merge-par's parent takes the next page from each sorted
+   chunk in turn and writes the merged result in order. */
+static void *
+merge_access (size_t i) 
+{
+  size_t step = i / (CHUNK_CNT + 1);
+  size_t chunk = i % (CHUNK_CNT + 1);
+
+  if (step >= CHUNK_PAGES)
+    return NULL;
+  if (chunk < CHUNK_CNT)
+    return DATA_BASE + (chunk * CHUNK_PAGES + step) * PGSIZE;
+  return DATA_BASE + (MERGE_PAGES + step * CHUNK_CNT) * PGSIZE;
+}
+
+/* Returns the page at VA in TABLE, or a null pointer. */
+static struct page *
+hash_find_page (struct hash *table, void *va) 
+{
+  struct page key_page;
+  struct hash_page key;
+  struct hash_elem *e;
+
+  key_page.va = pg_round_down (va);
+  key.page = &key_page;
+  e = hash_find (table, &key.elem);
+  return e != NULL ? hash_entry (e, struct hash_page, elem)->page : NULL;
+}
+
+/* Adds PAGE to the hash table TABLE_. */
+static bool
+add_hash_page (struct page *page, void *table_) 
+{
+  struct hash_page *p = malloc (sizeof *p);
+
+  ASSERT (p != NULL);
+  p->page = page;
+  hash_insert (table_, &p->elem);
+  return true;
+}
+
+/* Frees the hash table entry E. */
+static void
+free_hash_page (struct hash_elem *e, void *aux UNUSED) 
+{
+  free (hash_entry (e, struct hash_page, elem));
+}
+
+/* Returns a hash of the page's address. */
+static uint64_t
+hash_page_hash (const struct hash_elem *e, void *aux UNUSED) 
+{
+  const struct hash_page *p = hash_entry (e, struct hash_page, elem);
+  return hash_bytes (&p->page->va, sizeof p->page->va);
+}
+
+/* Returns true if A's page comes before B's. */
+static bool
+hash_page_less (const struct hash_elem *a, const struct hash_elem *b,
+                void *aux UNUSED) 
+{
+  const struct hash_page *pa = hash_entry (a, struct hash_page, elem);
+  const struct hash_page *pb = hash_entry (b, struct hash_page, elem);
+  return pa->page->va < pb->page->va;
+}
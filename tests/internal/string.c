@@ -0,0 +1,336 @@
+/* Test program for lib/string.c.
+
+   Checks memcpy(), memmove(), memset() and memcmp() against
+   byte-at-a-time loops for every size up to MAX_CHECK at every
+   alignment, including overlapping moves in both directions, and
+   then times them for sizes from 1 byte to 64 kB.
+
+   Also checks strlen(), strnlen(), strchr() and strcmp() for every
+   string length up to MAX_STRING at every alignment, with each
+   string ending right before a page boundary as well as away from
+   one, and times them on long strings.
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <debug.h>
+#include <random.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/test.h"
+#include "threads/vaddr.h"
+#include "intrinsic.h"
+
+/* Largest size checked against the byte loops. */
+#define MAX_CHECK 600
+
+/* Largest size timed. */
+#define MAX_BENCH (64 * 1024)
+
+/* Times each timed call is repeated. */
+#define BENCH_REPS 16
+
+/* Longest string checked. */
+#define MAX_STRING 100
+
+static unsigned char src[MAX_BENCH + 64], dst[MAX_BENCH + 64];
+static unsigned char ref[MAX_BENCH + 64];
+
+static void check_blocks (size_t size, int dst_ofs, int src_ofs);
+static void bench (void);
+static void check_strings (size_t length, int ofs);
+static void bench_strings (void);
+static size_t ref_strlen (const char *);
+static int ref_strcmp (const char *, const char *);
+static void fill_random (unsigned char *, size_t);
+static int sign (int);
+
+/* Test the block functions. */
+void
+test (void) 
+{
+  size_t size;
+
+  printf ("testing block functions:");
+  for (size = 0; size <= MAX_CHECK; size = size < 64 ? size + 1 : size * 5 / 4)
+    {
+      int dst_ofs, src_ofs;
+
+      printf (" %zu", size);
+      for (dst_ofs = 0; dst_ofs < 16; dst_ofs++)
+        for (src_ofs = 0; src_ofs < 16; src_ofs++)
+          check_blocks (size, dst_ofs, src_ofs);
+    }
+  printf (" done\n");
+
+  printf ("testing string functions:");
+  for (size = 0; size <= MAX_STRING; size++)
+    {
+      int ofs;
+
+      printf (" %zu", size);
+      for (ofs = 0; ofs < 16; ofs++)
+        check_strings (size, ofs);
+    }
+  printf (" done\n");
+
+  bench ();
+  bench_strings ();
+  printf ("string: PASS\n");
+}
+
+/* Checks each block function on SIZE bytes at offsets DST_OFS
+   and SRC_OFS from the start of the buffers. */
+static void
+check_blocks (size_t size, int dst_ofs, int src_ofs) 
+{
+  int value = random_ulong ();
+  size_t i;
+
+  /* memcpy(). */
+  fill_random (src, sizeof src);
+  fill_random (dst, sizeof dst);
+  memcpy (ref, dst, sizeof ref);
+  for (i = 0; i < size; i++)
+    ref[dst_ofs + i] = src[src_ofs + i];
+  ASSERT (memcpy (dst + dst_ofs, src + src_ofs, size) == dst + dst_ofs);
+  for (i = 0; i < sizeof dst; i++)
+    ASSERT (dst[i] == ref[i]);
+
+  /* memset(). */
+  for (i = 0; i < size; i++)
+    ref[dst_ofs + i] = value;
+  ASSERT (memset (dst + dst_ofs, value, size) == dst + dst_ofs);
+  for (i = 0; i < sizeof dst; i++)
+    ASSERT (dst[i] == ref[i]);
+
+  /* memmove() within one buffer, in whichever direction the
+     offsets call for. */
+  memcpy (ref, dst, sizeof ref);
+  if (dst_ofs < src_ofs)
+    for (i = 0; i < size; i++)
+      ref[dst_ofs + i] = ref[src_ofs + i];
+  else
+    for (i = size; i-- > 0; )
+      ref[dst_ofs + i] = ref[src_ofs + i];
+  ASSERT (memmove (dst + dst_ofs, dst + src_ofs, size) == dst + dst_ofs);
+  for (i = 0; i < sizeof dst; i++)
+    ASSERT (dst[i] == ref[i]);
+
+  /* memcmp(), with equal blocks and with one byte changed. */
+  memcpy (dst + dst_ofs, src + src_ofs, size);
+  ASSERT (memcmp (dst + dst_ofs, src + src_ofs, size) == 0);
+  if (size > 0)
+    {
+      size_t ofs = random_ulong () % size;
+      int expected;
+
+      dst[dst_ofs + ofs] ^= 1 << random_ulong () % 8;
+      expected = dst[dst_ofs + ofs] > src[src_ofs + ofs] ? 1 : -1;
+      ASSERT (sign (memcmp (dst + dst_ofs, src + src_ofs, size)) == expected);
+    }
+}
+
+/* Prints the cycles taken per call for sizes from 1 byte to
+   MAX_BENCH bytes, both with the buffers aligned and with them
+   misaligned by a few bytes. */
+static void
+bench (void) 
+{
+  size_t size;
+
+  printf ("size   align   memcpy   memmove   memset   memcmp  (cycles)\n");
+  for (size = 1; size <= MAX_BENCH; size *= 4)
+    {
+      int ofs;
+
+      for (ofs = 0; ofs < 8; ofs += 3)
+        {
+          uint64_t cycles[4], start;
+          int i;
+
+          memset (src, 0x5a, sizeof src);
+          memset (dst, 0x5a, sizeof dst);
+
+          start = rdtsc ();
+          for (i = 0; i < BENCH_REPS; i++)
+            memcpy (dst + ofs, src, size);
+          cycles[0] = rdtsc () - start;
+
+          start = rdtsc ();
+          for (i = 0; i < BENCH_REPS; i++)
+            memmove (dst + ofs, dst, size);
+          cycles[1] = rdtsc () - start;
+
+          start = rdtsc ();
+          for (i = 0; i < BENCH_REPS; i++)
+            memset (dst + ofs, 0, size);
+          cycles[2] = rdtsc () - start;
+
+          memset (src, 0, sizeof src);
+          start = rdtsc ();
+          for (i = 0; i < BENCH_REPS; i++)
+            ASSERT (memcmp (dst + ofs, src, size) == 0);
+          cycles[3] = rdtsc () - start;
+
+          printf ("%5zu   %d   %8llu %9llu %8llu %8llu\n", size, ofs,
+                  (unsigned long long) cycles[0] / BENCH_REPS,
+                  (unsigned long long) cycles[1] / BENCH_REPS,
+                  (unsigned long long) cycles[2] / BENCH_REPS,
+                  (unsigned long long) cycles[3] / BENCH_REPS);
+        }
+    }
+}
+
+/* Checks the string functions on a string of LENGTH characters
+   placed OFS bytes into `src' and, so that word reads past the
+   terminator would cross into the next page, right before the
+   end of a page. */
+static void
+check_strings (size_t length, int ofs) 
+{
+  static char page_end[2 * PGSIZE];
+  char *strings[2];
+  int i;
+
+  strings[0] = (char *) src + ofs;
+  strings[1] = pg_round_up (page_end) + PGSIZE - 1 - length;
+  if (ofs % 2)
+    strings[1] -= ofs;
+
+  for (i = 0; i < 2; i++)
+    {
+      char *s = strings[i];
+      char *t = (char *) dst + random_ulong () % 16;
+      size_t j, maxlen;
+      int c;
+
+      /* Random characters from a small set, so that strchr() and
+         strcmp() find matches. */
+      for (j = 0; j < length; j++)
+        s[j] = 'a' + random_ulong () % 4;
+      s[length] = '\0';
+
+      ASSERT (strlen (s) == length);
+      for (maxlen = 0; maxlen <= length + 9; maxlen++)
+        ASSERT (strnlen (s, maxlen) == (maxlen < length ? maxlen : length));
+      for (c = 'a'; c <= 'e'; c++)
+        {
+          char *p = memchr (s, c, length);
+          ASSERT (strchr (s, c) == p);
+        }
+      ASSERT (strchr (s, '\0') == s + length);
+
+      /* Compare with a copy at another alignment, with the copy
+         cut short, and with one character changed. */
+      memcpy (t, s, length + 1);
+      ASSERT (strcmp (s, t) == 0);
+      if (length > 0)
+        {
+          j = random_ulong () % length;
+          t[j] = 'a' + random_ulong () % 5;
+          ASSERT (sign (strcmp (s, t)) == ref_strcmp (s, t));
+          ASSERT (sign (strcmp (t, s)) == ref_strcmp (t, s));
+          t[j] = '\0';
+          ASSERT (sign (strcmp (s, t)) == ref_strcmp (s, t));
+          ASSERT (sign (strcmp (t, s)) == ref_strcmp (t, s));
+        }
+    }
+}
+
+/* Prints the cycles taken by the string functions on strings of
+   growing length, and by byte loops for comparison. */
+static void
+bench_strings (void) 
+{
+  size_t length;
+
+  printf ("length  strlen  (bytes)  strchr   strcmp  (bytes)  (cycles)\n");
+  for (length = 16; length <= 4096; length *= 4)
+    {
+      char *s = (char *) src + 1, *t = (char *) dst + 5;
+      uint64_t cycles[5], start;
+      int i;
+
+      memset (s, 'x', length);
+      s[length] = '\0';
+      memcpy (t, s, length + 1);
+
+      start = rdtsc ();
+      for (i = 0; i < BENCH_REPS; i++)
+        ASSERT (strlen (s) == length);
+      cycles[0] = rdtsc () - start;
+
+      start = rdtsc ();
+      for (i = 0; i < BENCH_REPS; i++)
+        ASSERT (ref_strlen (s) == length);
+      cycles[1] = rdtsc () - start;
+
+      start = rdtsc ();
+      for (i = 0; i < BENCH_REPS; i++)
+        ASSERT (strchr (s, 'y') == NULL);
+      cycles[2] = rdtsc () - start;
+
+      start = rdtsc ();
+      for (i = 0; i < BENCH_REPS; i++)
+        ASSERT (strcmp (s, t) == 0);
+      cycles[3] = rdtsc () - start;
+
+      start = rdtsc ();
+      for (i = 0; i < BENCH_REPS; i++)
+        ASSERT (ref_strcmp (s, t) == 0);
+      cycles[4] = rdtsc () - start;
+
+      printf ("%6zu %7llu %8llu %8llu %8llu %8llu\n", length,
+              (unsigned long long) cycles[0] / BENCH_REPS,
+              (unsigned long long) cycles[1] / BENCH_REPS,
+              (unsigned long long) cycles[2] / BENCH_REPS,
+              (unsigned long long) cycles[3] / BENCH_REPS,
+              (unsigned long long) cycles[4] / BENCH_REPS);
+    }
+}
+
+/* Returns the length of S, counting a byte at a time. */
+static size_t
+ref_strlen (const char *s) 
+{
+  size_t length = 0;
+
+  while (s[length] != '\0')
+    length++;
+  return length;
+}
+
+/* Compares A and B a byte at a time, returning -1, 0 or 1. */
+static int
+ref_strcmp (const char *a_, const char *b_) 
+{
+  const unsigned char *a = (const unsigned char *) a_;
+  const unsigned char *b = (const unsigned char *) b_;
+
+  while (*a != '\0' && *a == *b)
+    {
+      a++;
+      b++;
+    }
+  return *a < *b ? -1 : *a > *b;
+}
+
+/* Fills the SIZE bytes at P with random values. */
+static void
+fill_random (unsigned char *p, size_t size) 
+{
+  size_t i;
+
+  for (i = 0; i < size; i++)
+    p[i] = random_ulong ();
+}
+
+/* Returns -1, 0 or 1 as X is negative, zero or positive. */
+static int
+sign (int x) 
+{
+  return (x > 0) - (x < 0);
+}
@@ -0,0 +1,131 @@
+/* Parks 5000 sleeping threads and checks that the timer
+   interrupt does not get slower on ticks where none of them is
+   due.
+
+   The average cost of the timer interrupt handler is measured
+   twice over the same number of ticks: once with no other
+   sleepers, and once with SLEEPER_CNT threads asleep until well
+   after the measurement window.  Afterward every sleeper must
+   have woken up no earlier than it asked to. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define SLEEPER_CNT 5000
+#define MEASURE_TICKS 50        /* Length of each measurement. */
+#define SLEEP_TICKS 1000        /* Minimum sleep of each sleeper. */
+#define WAKE_SPREAD 64          /* Sleepers wake over this many ticks. */
+
+/* Largest tolerated ratio between the average interrupt cost
+   with and without the sleepers. */
+#define MAX_SLOWDOWN 4
+
+struct sleeper
+  {
+    int duration;               /* Number of ticks to sleep. */
+    int64_t wakeup;             /* Earliest acceptable wake-up tick. */
+    int64_t woke;               /* Tick at which it woke up. */
+  };
+
+static struct semaphore done;
+static int parked;
+
+static thread_func sleeper_func;
+static uint64_t measure_interrupts (void);
+
+void
+test_alarm_many (void)
+{
+  struct sleeper *sleepers;
+  uint64_t idle_cycles, loaded_cycles;
+  int early;
+  int i;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  msg ("Creating %d threads to sleep at least %d ticks each.",
+       SLEEPER_CNT, SLEEP_TICKS);
+
+  sleepers = malloc (sizeof *sleepers * SLEEPER_CNT);
+  if (sleepers == NULL)
+    PANIC ("couldn't allocate memory for test");
+  sema_init (&done, 0);
+
+  idle_cycles = measure_interrupts ();
+
+  /* Park the sleepers.  They run as soon as we sleep. */
+  parked = 0;
+  for (i = 0; i < SLEEPER_CNT; i++)
+    {
+      struct sleeper *s = &sleepers[i];
+      s->duration = SLEEP_TICKS + i % WAKE_SPREAD;
+      if (thread_create ("sleeper", PRI_DEFAULT, sleeper_func, s)
+          == TID_ERROR)
+        PANIC ("couldn't create sleeper %d", i);
+    }
+  while (parked < SLEEPER_CNT)
+    timer_sleep (1);
+
+  loaded_cycles = measure_interrupts ();
+
+  /* Wait for every sleeper to wake up. */
+  for (i = 0; i < SLEEPER_CNT; i++)
+    sema_down (&done);
+
+  early = 0;
+  for (i = 0; i < SLEEPER_CNT; i++)
+    if (sleepers[i].woke < sleepers[i].wakeup)
+      early++;
+  free (sleepers);
+
+  msg ("Without sleepers: %llu cycles per timer interrupt.",
+       (unsigned long long) idle_cycles);
+  msg ("With %d sleepers: %llu cycles per timer interrupt.",
+       SLEEPER_CNT, (unsigned long long) loaded_cycles);
+
+  if (early != 0)
+    fail ("%d sleepers woke up early.", early);
+  if (loaded_cycles > idle_cycles * MAX_SLOWDOWN)
+    fail ("timer interrupt slowed down from %llu to %llu cycles.",
+          (unsigned long long) idle_cycles,
+          (unsigned long long) loaded_cycles);
+  pass ();
+}
+
+/* Sleeps for MEASURE_TICKS and returns the average number of
+   cycles spent per timer interrupt meanwhile. */
+static uint64_t
+measure_interrupts (void)
+{
+  struct timer_intr_stats stats;
+
+  timer_reset_intr_stats ();
+  timer_sleep (MEASURE_TICKS);
+  timer_get_intr_stats (&stats);
+
+  return stats.cnt > 0 ? stats.total_cycles / stats.cnt : 0;
+}
+
+static void
+sleeper_func (void *sleeper_)
+{
+  struct sleeper *s = sleeper_;
+  enum intr_level old_level;
+
+  /* Count ourselves and fall asleep without a window in between. */
+  old_level = intr_disable ();
+  parked++;
+  s->wakeup = timer_ticks () + s->duration;
+  timer_sleep (s->duration);
+  intr_set_level (old_level);
+
+  s->woke = timer_ticks ();
+  sema_up (&done);
+}
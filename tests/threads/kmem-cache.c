@@ -0,0 +1,120 @@
+/* Checks the object cache allocator.
+
+   Allocates OBJ_CNT objects from a cache with a constructor,
+   checks that each comes constructed and does not overlap any
+   other, and frees them in a scrambled order, checking that the
+   cache gives back all but its spare empty slabs.  Then does it
+   again, to make sure that freed objects come back in their
+   constructed state without running the constructor again.
+   Finally checks that a cache packs objects more tightly than
+   malloc() does. */
+
+#include <stdio.h>
+#include <string.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/malloc.h"
+#include "threads/vaddr.h"
+
+#define OBJ_CNT 500
+#define CTOR_MAGIC 0x1234abcd
+
+/* An object with an awkward size, which malloc() would round up
+   from 72 to 128 bytes. */
+struct obj
+  {
+    unsigned magic;             /* Set by the constructor. */
+    int owner;                  /* Index of the allocation. */
+    char data[64];              /* Filled with the owner's index. */
+  };
+
+static struct kmem_cache cache;
+static int ctor_cnt;
+static struct obj *objs[OBJ_CNT];
+
+static void obj_ctor (void *);
+static void alloc_all (void);
+static void free_all (void);
+
+void
+test_kmem_cache (void)
+{
+  int first_ctor_cnt;
+
+  kmem_cache_init (&cache, "test", sizeof (struct obj), obj_ctor);
+
+  alloc_all ();
+  first_ctor_cnt = ctor_cnt;
+  if ((size_t) ctor_cnt != cache.slab_cnt * cache.objs_per_slab)
+    fail ("%d constructor calls for %zu slabs.", ctor_cnt, cache.slab_cnt);
+  msg ("%d objects in %zu slabs of %zu objects.",
+       OBJ_CNT, cache.slab_cnt, cache.objs_per_slab);
+  free_all ();
+
+  alloc_all ();
+  if (ctor_cnt != first_ctor_cnt)
+    fail ("constructor ran %d more times.", ctor_cnt - first_ctor_cnt);
+  free_all ();
+
+  if (cache.objs_per_slab <= (PGSIZE - 32) / 128)
+    fail ("%zu objects per slab is no better than malloc().",
+          cache.objs_per_slab);
+  pass ();
+}
+
+static void
+obj_ctor (void *obj_)
+{
+  struct obj *obj = obj_;
+
+  obj->magic = CTOR_MAGIC;
+  obj->owner = -1;
+  ctor_cnt++;
+}
+
+/* Allocates OBJ_CNT objects into `objs', checking each one. */
+static void
+alloc_all (void)
+{
+  int i;
+
+  for (i = 0; i < OBJ_CNT; i++)
+    {
+      struct obj *obj = objs[i] = kmem_cache_alloc (&cache);
+
+      if (obj == NULL)
+        fail ("out of memory after %d objects.", i);
+      if (obj->magic != CTOR_MAGIC || obj->owner != -1)
+        fail ("object %d is not in its constructed state.", i);
+      obj->owner = i;
+      memset (obj->data, i, sizeof obj->data);
+    }
+  if (cache.obj_cnt != OBJ_CNT)
+    fail ("cache counts %zu objects, not %d.", cache.obj_cnt, OBJ_CNT);
+}
+
+/* Checks and frees the objects in `objs', in a scrambled order,
+   and checks that the cache keeps no more than one empty slab. */
+static void
+free_all (void)
+{
+  int i;
+
+  for (i = 0; i < OBJ_CNT; i++)
+    {
+      int idx = (i * 7) % OBJ_CNT;
+      struct obj *obj = objs[idx];
+      size_t j;
+
+      if (obj->owner != idx)
+        fail ("object %d was overwritten by object %d.", idx, obj->owner);
+      for (j = 0; j < sizeof obj->data; j++)
+        if (obj->data[j] != (char) idx)
+          fail ("object %d's data was overwritten.", idx);
+      obj->owner = -1;
+      kmem_cache_free (&cache, obj);
+    }
+  if (cache.obj_cnt != 0 || cache.slab_cnt > 1)
+    fail ("cache kept %zu objects in %zu slabs.",
+          cache.obj_cnt, cache.slab_cnt);
+}
@@ -0,0 +1,104 @@
+/* Checks malloc()'s large blocks, between 1 kB and 16 kB.
+
+   Allocates BLOCK_CNT blocks of 2100 bytes, which used to take 2
+   pages each, and checks that they now take a 3 kB block each and
+   do not overlap.  Then grows a block with realloc(), which should
+   happen in place when the slots after it are free, and checks
+   that a block whose neighbour is in use is moved with its
+   contents intact. */
+
+#include <stdio.h>
+#include <string.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/malloc.h"
+
+#define BLOCK_CNT 16
+#define BLOCK_SIZE 2100
+
+static void fill (void *, size_t, int);
+static void check (const void *, size_t, int);
+
+void
+test_malloc_large (void)
+{
+  struct malloc_stats before, after;
+  char *blocks[BLOCK_CNT];
+  char *p, *q, *first;
+  int i;
+
+  malloc_get_stats (BLOCK_SIZE, &before);
+  for (i = 0; i < BLOCK_CNT; i++)
+    {
+      blocks[i] = malloc (BLOCK_SIZE);
+      if (blocks[i] == NULL)
+        fail ("out of memory.");
+      fill (blocks[i], BLOCK_SIZE, i);
+    }
+  malloc_get_stats (BLOCK_SIZE, &after);
+  for (i = 0; i < BLOCK_CNT; i++)
+    check (blocks[i], BLOCK_SIZE, i);
+  if (after.alloc_cnt - before.alloc_cnt != BLOCK_CNT
+      || after.granted - before.granted != BLOCK_CNT * 3072)
+    fail ("%d-byte blocks were not served as 3 kB blocks.", BLOCK_SIZE);
+  msg ("%d blocks of %d bytes took %d bytes each.",
+       BLOCK_CNT, BLOCK_SIZE, 3072);
+  for (i = 0; i < BLOCK_CNT; i++)
+    free (blocks[i]);
+
+  /* The first block of a new arena has free slots after it. */
+  p = malloc (BLOCK_SIZE);
+  if (p == NULL)
+    fail ("out of memory.");
+  fill (p, BLOCK_SIZE, 1);
+  q = realloc (p, 3 * BLOCK_SIZE);
+  if (q != p)
+    fail ("realloc() moved a block with free slots after it.");
+  check (q, BLOCK_SIZE, 1);
+  msg ("grew a block in place.");
+
+  /* Shrinking never moves a block. */
+  first = realloc (q, 100);
+  if (first != q)
+    fail ("realloc() moved a shrinking block.");
+
+  /* Now fill the rest of the arena, so that the next block has
+     no room to grow. */
+  p = malloc (BLOCK_SIZE);
+  fill (p, BLOCK_SIZE, 2);
+  blocks[0] = malloc (BLOCK_SIZE);
+  fill (blocks[0], BLOCK_SIZE, 3);
+  q = realloc (p, 3 * BLOCK_SIZE);
+  if (q == NULL)
+    fail ("out of memory.");
+  check (q, BLOCK_SIZE, 2);
+  check (blocks[0], BLOCK_SIZE, 3);
+  msg ("moved a block without room to grow.");
+  free (q);
+  free (blocks[0]);
+  free (first);
+  pass ();
+}
+
+/* Fills the SIZE bytes at P with a pattern derived from SEED. */
+static void
+fill (void *p_, size_t size, int seed)
+{
+  unsigned char *p = p_;
+  size_t i;
+
+  for (i = 0; i < size; i++)
+    p[i] = i * 7 + seed;
+}
+
+/* Checks that the SIZE bytes at P hold the pattern for SEED. */
+static void
+check (const void *p_, size_t size, int seed)
+{
+  const unsigned char *p = p_;
+  size_t i;
+
+  for (i = 0; i < size; i++)
+    if (p[i] != (unsigned char) (i * 7 + seed))
+      fail ("byte %zu of block %d is wrong.", i, seed);
+}
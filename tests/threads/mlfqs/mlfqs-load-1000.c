@@ -0,0 +1,92 @@
+/* Checks that the worst-case cost of the timer interrupt under
+   the MLFQS does not grow with the number of threads.
+
+   Starts 100 and then 1000 threads that spin for SPIN_SECONDS
+   each, and records the slowest timer interrupt while they all
+   spin.  The per-second recent_cpu decay and the priority
+   updates that go with it must not be done for every thread at
+   once in the interrupt handler, so the slowest interrupt with
+   1000 threads should be about as fast as with 100. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define SPIN_SECONDS 3
+
+/* Largest tolerated ratio between the slowest interrupt with
+   1000 and with 100 threads. */
+#define MAX_SLOWDOWN 3
+
+static int64_t spin_until;
+static struct semaphore done;
+
+static void load_thread (void *aux);
+static uint64_t measure_load (int thread_cnt);
+
+void
+test_mlfqs_load_1000 (void)
+{
+  uint64_t cycles_100, cycles_1000;
+
+  ASSERT (thread_mlfqs);
+
+  sema_init (&done, 0);
+
+  cycles_100 = measure_load (100);
+  msg ("With 100 threads, slowest timer interrupt took %llu cycles.",
+       (unsigned long long) cycles_100);
+  cycles_1000 = measure_load (1000);
+  msg ("With 1000 threads, slowest timer interrupt took %llu cycles.",
+       (unsigned long long) cycles_1000);
+
+  if (cycles_1000 > cycles_100 * MAX_SLOWDOWN)
+    fail ("slowest timer interrupt grew from %llu to %llu cycles.",
+          (unsigned long long) cycles_100,
+          (unsigned long long) cycles_1000);
+  pass ();
+}
+
+/* Starts THREAD_CNT spinning threads and returns the number of
+   cycles spent in the slowest timer interrupt while they spin. */
+static uint64_t
+measure_load (int thread_cnt)
+{
+  struct timer_intr_stats stats;
+  int64_t spin_start;
+  int i;
+
+  /* Leave the threads time to start before measuring. */
+  spin_start = timer_ticks () + 2 * TIMER_FREQ;
+  spin_until = spin_start + SPIN_SECONDS * TIMER_FREQ;
+
+  msg ("Starting %d load threads...", thread_cnt);
+  for (i = 0; i < thread_cnt; i++)
+    {
+      char name[16];
+      snprintf (name, sizeof name, "load %d", i);
+      if (thread_create (name, PRI_DEFAULT, load_thread, NULL) == TID_ERROR)
+        PANIC ("couldn't create %s", name);
+    }
+
+  timer_sleep (spin_start - timer_ticks ());
+  timer_reset_intr_stats ();
+  timer_sleep (spin_until - timer_ticks ());
+  timer_get_intr_stats (&stats);
+
+  for (i = 0; i < thread_cnt; i++)
+    sema_down (&done);
+  return stats.max_cycles;
+}
+
+static void
+load_thread (void *aux UNUSED)
+{
+  while (timer_ticks () < spin_until)
+    continue;
+  sema_up (&done);
+}
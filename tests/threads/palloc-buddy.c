@@ -0,0 +1,162 @@
+/* Runs a random workload of 1 to 64 page allocations and frees
+   through palloc and through a bitmap allocator like the one it
+   used to have, and compares their cost.
+
+   The workload keeps up to SLOT_CNT blocks live.  Each step picks
+   a slot at random and frees its block if it has one, otherwise
+   allocates a block of random size for it.  The same sequence is
+   replayed against palloc's user pool and against a bitmap of
+   BITMAP_PAGES pages searched first-fit from the start, as
+   bitmap_scan_and_flip() does.  Every page palloc hands out is
+   stamped and checked again when freed, to catch blocks that
+   overlap. */
+
+#include <bitmap.h>
+#include <random.h>
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+#include "intrinsic.h"
+
+#define SLOT_CNT 32
+#define STEP_CNT 5000
+#define MAX_PAGES 64
+#define BITMAP_PAGES 2048
+
+struct slot
+  {
+    size_t page_cnt;            /* Size of the block, 0 if none. */
+    void *pages;                /* Block from palloc. */
+    size_t page_idx;            /* Block from the bitmap. */
+  };
+
+static struct slot slots[SLOT_CNT];
+
+static uint64_t run_palloc (int *failures);
+static uint64_t run_bitmap (int *failures);
+
+void
+test_palloc_buddy (void)
+{
+  int palloc_failures, bitmap_failures;
+  uint64_t palloc_cycles, bitmap_cycles;
+
+  palloc_cycles = run_palloc (&palloc_failures);
+  bitmap_cycles = run_bitmap (&bitmap_failures);
+
+  msg ("buddy:  %llu cycles per operation, %d failed allocations.",
+       (unsigned long long) palloc_cycles, palloc_failures);
+  msg ("bitmap: %llu cycles per operation, %d failed allocations.",
+       (unsigned long long) bitmap_cycles, bitmap_failures);
+
+  if (palloc_cycles > bitmap_cycles)
+    fail ("buddy allocator slower than the bitmap.");
+  pass ();
+}
+
+/* Runs the workload against palloc and returns the average cost
+   of an operation.  Stores the number of failed allocations in
+   *FAILURES. */
+static uint64_t
+run_palloc (int *failures)
+{
+  uint64_t cycles = 0;
+  int step;
+  size_t i;
+
+  random_init (0);
+  *failures = 0;
+  for (step = 0; step < STEP_CNT; step++)
+    {
+      struct slot *s = &slots[random_ulong () % SLOT_CNT];
+      uint64_t start;
+
+      if (s->page_cnt == 0)
+        {
+          size_t page_cnt = random_ulong () % MAX_PAGES + 1;
+
+          start = rdtsc ();
+          s->pages = palloc_get_multiple (PAL_USER, page_cnt);
+          cycles += rdtsc () - start;
+          if (s->pages == NULL)
+            {
+              ++*failures;
+              continue;
+            }
+          s->page_cnt = page_cnt;
+          for (i = 0; i < s->page_cnt; i++)
+            *(struct slot **) (s->pages + i * PGSIZE) = s;
+        }
+      else
+        {
+          for (i = 0; i < s->page_cnt; i++)
+            if (*(struct slot **) (s->pages + i * PGSIZE) != s)
+              fail ("page %zu of %zu-page block %p was overwritten.",
+                    i, s->page_cnt, s->pages);
+          start = rdtsc ();
+          palloc_free_multiple (s->pages, s->page_cnt);
+          cycles += rdtsc () - start;
+          s->page_cnt = 0;
+        }
+    }
+
+  for (i = 0; i < SLOT_CNT; i++)
+    if (slots[i].page_cnt != 0)
+      {
+        palloc_free_multiple (slots[i].pages, slots[i].page_cnt);
+        slots[i].page_cnt = 0;
+      }
+  return cycles / STEP_CNT;
+}
+
+/* Runs the workload against a first-fit bitmap and returns the
+   average cost of an operation.  Stores the number of failed
+   allocations in *FAILURES. */
+static uint64_t
+run_bitmap (int *failures)
+{
+  struct bitmap *map = bitmap_create (BITMAP_PAGES);
+  enum intr_level old_level;
+  uint64_t cycles = 0;
+  int step;
+  size_t i;
+
+  if (map == NULL)
+    fail ("couldn't allocate bitmap.");
+
+  random_init (0);
+  *failures = 0;
+  for (step = 0; step < STEP_CNT; step++)
+    {
+      struct slot *s = &slots[random_ulong () % SLOT_CNT];
+      size_t page_cnt = s->page_cnt;
+      uint64_t start;
+
+      if (page_cnt == 0)
+        page_cnt = random_ulong () % MAX_PAGES + 1;
+
+      /* Interrupts off, as palloc does. */
+      old_level = intr_disable ();
+      start = rdtsc ();
+      if (s->page_cnt == 0)
+        s->page_idx = bitmap_scan_and_flip (map, 0, page_cnt, false);
+      else
+        bitmap_set_multiple (map, s->page_idx, page_cnt, false);
+      cycles += rdtsc () - start;
+      intr_set_level (old_level);
+
+      if (s->page_cnt != 0)
+        s->page_cnt = 0;
+      else if (s->page_idx != BITMAP_ERROR)
+        s->page_cnt = page_cnt;
+      else
+        ++*failures;
+    }
+
+  for (i = 0; i < SLOT_CNT; i++)
+    slots[i].page_cnt = 0;
+  bitmap_destroy (map);
+  return cycles / STEP_CNT;
+}
@@ -0,0 +1,95 @@
+/* Counts how often the page allocator has to go to its pools
+   during fork/exit churn, with and without per-thread magazines.
+
+   The main thread starts CHILD_CNT short-lived children one after
+   another, as a shell running many commands would.  Each child
+   allocates and frees the pages a forked process typically needs
+   (a zeroed page table page from the kernel pool, and a stack page
+   and an argument page from the user pool) and exits, after which
+   its own page is freed too.  With magazines, many of these pages
+   should come from and go back to a magazine instead of a pool,
+   though each child still has to fill its empty magazines once. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define CHILD_CNT 200
+
+/* Largest tolerated share of the pool trips without magazines
+   still made with them, in percent. */
+#define MAX_TRIPS_PCT 67
+
+static struct semaphore done;
+
+static thread_func child_func;
+static uint64_t measure_trips (bool magazines);
+
+void
+test_palloc_magazine (void)
+{
+  bool saved = palloc_magazines;
+  uint64_t without, with;
+
+  sema_init (&done, 0);
+  without = measure_trips (false);
+  with = measure_trips (true);
+  palloc_magazines = saved;
+
+  msg ("%d forks without magazines: %llu pool trips.",
+       CHILD_CNT, (unsigned long long) without);
+  msg ("%d forks with magazines: %llu pool trips.",
+       CHILD_CNT, (unsigned long long) with);
+
+  if (with * 100 > without * MAX_TRIPS_PCT)
+    fail ("magazines saved too few pool trips.");
+  pass ();
+}
+
+/* Runs the children with magazines on or off, as MAGAZINES says,
+   and returns the number of trips to the kernel and user pools. */
+static uint64_t
+measure_trips (bool magazines)
+{
+  struct palloc_stats kernel_before, user_before, kernel_after, user_after;
+  int i;
+
+  palloc_magazines = magazines;
+
+  /* Let the idle thread refill the pre-zeroed pages, so that both
+     runs start with the same number of them. */
+  timer_sleep (1);
+
+  palloc_get_stats (0, &kernel_before);
+  palloc_get_stats (PAL_USER, &user_before);
+  for (i = 0; i < CHILD_CNT; i++)
+    {
+      if (thread_create ("child", PRI_DEFAULT, child_func, NULL) == TID_ERROR)
+        fail ("couldn't create child %d.", i);
+      sema_down (&done);
+    }
+  palloc_get_stats (0, &kernel_after);
+  palloc_get_stats (PAL_USER, &user_after);
+
+  return (kernel_after.pool_trips - kernel_before.pool_trips)
+         + (user_after.pool_trips - user_before.pool_trips);
+}
+
+static void
+child_func (void *aux UNUSED)
+{
+  void *pml4 = palloc_get_page (PAL_ZERO);
+  void *stack = palloc_get_page (PAL_USER);
+  void *args = palloc_get_page (PAL_USER);
+
+  if (pml4 == NULL || stack == NULL || args == NULL)
+    fail ("out of pages.");
+  palloc_free_page (args);
+  palloc_free_page (stack);
+  palloc_free_page (pml4);
+  sema_up (&done);
+}
@@ -0,0 +1,106 @@
+/* Checks the pages the idle thread zeroes ahead of PAL_ZERO
+   requests.
+
+   The main thread sleeps so that the idle thread can zero some
+   free pages, then allocates ZERO_CNT zeroed pages and checks that
+   they were served from the pre-zeroed pages, without a memset,
+   and that they really are zero.  It scribbles on them and frees
+   them, and does the same again, to make sure freed pages are
+   zeroed afresh.  Finally it allocates every page in the user pool
+   twice, with a sleep in between, to make sure that the pages held
+   zeroed are given back when the pool runs dry. */
+
+#include <stdio.h>
+#include <string.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+#include "devices/timer.h"
+
+#define ZERO_CNT 32
+#define ROUND_CNT 2
+
+static void check_zeroed_pages (int round);
+static size_t drain_user_pool (void);
+
+void
+test_palloc_zero (void)
+{
+  size_t first, second;
+  int round;
+
+  for (round = 0; round < ROUND_CNT; round++)
+    check_zeroed_pages (round);
+
+  first = drain_user_pool ();
+  timer_sleep (1);
+  second = drain_user_pool ();
+  if (first != second)
+    fail ("user pool shrank from %zu to %zu pages.", first, second);
+  msg ("user pool held %zu pages both times.", first);
+  pass ();
+}
+
+/* Allocates ZERO_CNT zeroed pages after a sleep, checks that they
+   came from the pre-zeroed pages and hold only zeros, then dirties
+   and frees them. */
+static void
+check_zeroed_pages (int round)
+{
+  void *pages[ZERO_CNT];
+  struct palloc_stats before, after;
+  int i;
+
+  timer_sleep (1);
+  palloc_get_stats (0, &before);
+  for (i = 0; i < ZERO_CNT; i++)
+    {
+      uint8_t *page = pages[i] = palloc_get_page (PAL_ZERO);
+      size_t ofs;
+
+      if (page == NULL)
+        fail ("out of pages.");
+      for (ofs = 0; ofs < PGSIZE; ofs++)
+        if (page[ofs] != 0)
+          fail ("page %d byte %zu is %#x, not zero.", i, ofs, page[ofs]);
+    }
+  palloc_get_stats (0, &after);
+
+  if (after.zeroed_hits - before.zeroed_hits != ZERO_CNT)
+    fail ("round %d: only %llu of %d pages were pre-zeroed.", round,
+          (unsigned long long) (after.zeroed_hits - before.zeroed_hits),
+          ZERO_CNT);
+  msg ("round %d: %d pages pre-zeroed.", round, ZERO_CNT);
+
+  for (i = 0; i < ZERO_CNT; i++)
+    {
+      memset (pages[i], 0x5a, PGSIZE);
+      palloc_free_page (pages[i]);
+    }
+}
+
+/* Allocates user pages until none is left, then frees them all.
+   Returns the number of pages allocated. */
+static size_t
+drain_user_pool (void)
+{
+  void *list = NULL;
+  void *page;
+  size_t cnt = 0;
+
+  /* Chain the pages through their first word. */
+  while ((page = palloc_get_page (PAL_USER)) != NULL)
+    {
+      *(void **) page = list;
+      list = page;
+      cnt++;
+    }
+  while (list != NULL)
+    {
+      page = list;
+      list = *(void **) page;
+      palloc_free_page (page);
+    }
+  return cnt;
+}
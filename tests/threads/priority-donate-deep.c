@@ -0,0 +1,112 @@
+/* Builds a chain of 64 nested locks and reports what priority
+   donation costs at each depth.
+
+   The main thread drops to PRI_MIN and acquires lock 0.  Then,
+   for each I from 1 to 63, it creates thread I at priority
+   PRI_MIN + I.  Thread I acquires lock I and then blocks on lock
+   I - 1, so its priority has to be donated through I locks to
+   reach the main thread.  The main thread times each
+   thread_create() call, which covers creating thread I, running
+   it until it blocks, and the donation itself, and checks that
+   the donation arrived.
+
+   Releasing lock 0 then unwinds the chain: each thread releases
+   the lock it waited for and the one it held, so the threads
+   should finish from thread 63 down to thread 1. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "intrinsic.h"
+
+#define LOCK_CNT 64
+
+struct donor
+  {
+    int id;                     /* Thread number. */
+    struct lock *held;          /* Lock acquired first. */
+    struct lock *wanted;        /* Lock then waited for. */
+  };
+
+static int finished[LOCK_CNT];
+static int finish_cnt;
+
+static thread_func donor_thread_func;
+
+void
+test_priority_donate_deep (void)
+{
+  struct lock *locks;
+  struct donor *donors;
+  uint64_t start, cycles, total;
+  int i;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  locks = malloc (sizeof *locks * LOCK_CNT);
+  donors = malloc (sizeof *donors * LOCK_CNT);
+  if (locks == NULL || donors == NULL)
+    PANIC ("couldn't allocate memory for test");
+
+  thread_set_priority (PRI_MIN);
+  for (i = 0; i < LOCK_CNT; i++)
+    lock_init (&locks[i]);
+  lock_acquire (&locks[0]);
+
+  total = 0;
+  finish_cnt = 0;
+  for (i = 1; i < LOCK_CNT; i++)
+    {
+      char name[16];
+      struct donor *d = &donors[i];
+
+      d->id = i;
+      d->held = &locks[i];
+      d->wanted = &locks[i - 1];
+      snprintf (name, sizeof name, "donor %d", i);
+
+      start = rdtsc ();
+      thread_create (name, PRI_MIN + i, donor_thread_func, d);
+      cycles = rdtsc () - start;
+      total += cycles;
+
+      if (thread_get_priority () != PRI_MIN + i)
+        fail ("main should have priority %d.  Actual priority: %d.",
+              PRI_MIN + i, thread_get_priority ());
+      if (i == 1 || i % 16 == 0 || i == LOCK_CNT - 1)
+        msg ("Donation through %2d locks: %llu cycles.",
+             i, (unsigned long long) cycles);
+    }
+  msg ("Average over %d depths: %llu cycles.",
+       LOCK_CNT - 1, (unsigned long long) (total / (LOCK_CNT - 1)));
+
+  lock_release (&locks[0]);
+  if (thread_get_priority () != PRI_MIN)
+    fail ("main should have priority %d after release.  Actual priority: %d.",
+          PRI_MIN, thread_get_priority ());
+
+  for (i = 0; i < LOCK_CNT - 1; i++)
+    if (finished[i] != LOCK_CNT - 1 - i)
+      fail ("thread %d finished in place %d, expected thread %d.",
+            finished[i], i, LOCK_CNT - 1 - i);
+
+  free (donors);
+  free (locks);
+  pass ();
+}
+
+static void
+donor_thread_func (void *donor_)
+{
+  struct donor *d = donor_;
+
+  lock_acquire (d->held);
+  lock_acquire (d->wanted);
+  lock_release (d->wanted);
+  lock_release (d->held);
+  finished[finish_cnt++] = d->id;
+}
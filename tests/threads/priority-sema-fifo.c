@@ -0,0 +1,44 @@
+/* Tests that threads waiting on a semaphore wake up in order of
+   priority, and in the order they started waiting among threads
+   of equal priority. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+#define THREAD_CNT 6
+
+static thread_func priority_sema_fifo_thread;
+static struct semaphore sema;
+
+void
+test_priority_sema_fifo (void) 
+{
+  static const int priorities[THREAD_CNT] = {32, 33, 32, 33, 32, 33};
+  int i;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  sema_init (&sema, 0);
+  thread_set_priority (PRI_MIN);
+  for (i = 0; i < THREAD_CNT; i++) 
+    {
+      char name[16];
+      snprintf (name, sizeof name, "%d/%d", i, priorities[i]);
+      thread_create (name, priorities[i], priority_sema_fifo_thread, NULL);
+    }
+
+  for (i = 0; i < THREAD_CNT; i++) 
+    sema_up (&sema);
+  msg ("Back in main thread."); 
+}
+
+static void
+priority_sema_fifo_thread (void *aux UNUSED) 
+{
+  sema_down (&sema);
+  msg ("Thread %s woke up.", thread_name ());
+}
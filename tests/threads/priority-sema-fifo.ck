@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(priority-sema-fifo) begin
+(priority-sema-fifo) Thread 1/33 woke up.
+(priority-sema-fifo) Thread 3/33 woke up.
+(priority-sema-fifo) Thread 5/33 woke up.
+(priority-sema-fifo) Thread 0/32 woke up.
+(priority-sema-fifo) Thread 2/32 woke up.
+(priority-sema-fifo) Thread 4/32 woke up.
+(priority-sema-fifo) Back in main thread.
+(priority-sema-fifo) end
+EOF
+pass;
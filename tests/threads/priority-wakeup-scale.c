@@ -0,0 +1,140 @@
+/* Measures the cost of waking a blocked thread as the number of
+   ready threads grows from 10 to 1000.
+
+   The main thread parks WAKE_CNT low-priority waiters, each on
+   its own semaphore, then fills the ready queue with READY_CNT
+   threads whose priority lies between the waiters' and its own.
+   It then wakes every waiter with interrupts off and reads the
+   time stamp counter around the loop.  Each wakeup has to queue
+   the waiter behind all of the ready threads, so with an ordered
+   ready list the cost grows with READY_CNT; with per-priority
+   ready queues it should stay flat. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+#include "intrinsic.h"
+
+#define WAKE_CNT 256
+#define WAITER_PRI (PRI_MIN + 1)
+#define FILLER_PRI (PRI_DEFAULT - 1)
+
+/* Largest tolerated ratio between the per-wakeup cost with the
+   most and the fewest ready threads. */
+#define MAX_SLOWDOWN 3
+
+static const int ready_counts[] = {10, 100, 1000};
+#define ROUND_CNT ((int) (sizeof ready_counts / sizeof *ready_counts))
+
+struct waiter
+  {
+    struct semaphore sema;      /* Upped once to wake the waiter. */
+  };
+
+static struct semaphore exited;
+static int parked;
+
+static thread_func waiter_func;
+static thread_func filler_func;
+static uint64_t measure_wakeups (int ready_cnt);
+
+void
+test_priority_wakeup_scale (void)
+{
+  uint64_t cycles[ROUND_CNT];
+  int i;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  /* Make sure our priority is the default. */
+  ASSERT (thread_get_priority () == PRI_DEFAULT);
+
+  sema_init (&exited, 0);
+  for (i = 0; i < ROUND_CNT; i++)
+    {
+      cycles[i] = measure_wakeups (ready_counts[i]);
+      msg ("%4d ready threads: %llu cycles per wakeup.",
+           ready_counts[i], (unsigned long long) cycles[i]);
+    }
+
+  if (cycles[ROUND_CNT - 1] > cycles[0] * MAX_SLOWDOWN)
+    fail ("wakeup cost grew from %llu to %llu cycles.",
+          (unsigned long long) cycles[0],
+          (unsigned long long) cycles[ROUND_CNT - 1]);
+  pass ();
+}
+
+/* Wakes WAKE_CNT parked threads while READY_CNT other threads
+   are ready to run, and returns the average number of cycles
+   spent per wakeup. */
+static uint64_t
+measure_wakeups (int ready_cnt)
+{
+  struct waiter *waiters;
+  enum intr_level old_level;
+  uint64_t start, cycles;
+  int i;
+
+  waiters = malloc (sizeof *waiters * WAKE_CNT);
+  if (waiters == NULL)
+    PANIC ("couldn't allocate memory for test");
+
+  /* Park the waiters.  They only run once we sleep. */
+  parked = 0;
+  for (i = 0; i < WAKE_CNT; i++)
+    {
+      sema_init (&waiters[i].sema, 0);
+      if (thread_create ("waiter", WAITER_PRI, waiter_func, &waiters[i])
+          == TID_ERROR)
+        PANIC ("couldn't create waiter");
+    }
+  while (parked < WAKE_CNT)
+    timer_sleep (1);
+
+  /* Fill the ready queue.  The fillers outrank the waiters but
+     not us, so none of them runs until we block. */
+  for (i = 0; i < ready_cnt; i++)
+    if (thread_create ("filler", FILLER_PRI, filler_func, NULL) == TID_ERROR)
+      PANIC ("couldn't create filler");
+
+  old_level = intr_disable ();
+  start = rdtsc ();
+  for (i = 0; i < WAKE_CNT; i++)
+    sema_up (&waiters[i].sema);
+  cycles = rdtsc () - start;
+  intr_set_level (old_level);
+
+  /* Let everyone run to completion. */
+  for (i = 0; i < WAKE_CNT + ready_cnt; i++)
+    sema_down (&exited);
+  free (waiters);
+
+  return cycles / WAKE_CNT;
+}
+
+static void
+waiter_func (void *waiter_)
+{
+  struct waiter *w = waiter_;
+  enum intr_level old_level;
+
+  /* Count ourselves and block without a window in between. */
+  old_level = intr_disable ();
+  parked++;
+  sema_down (&w->sema);
+  intr_set_level (old_level);
+
+  sema_up (&exited);
+}
+
+static void
+filler_func (void *aux UNUSED)
+{
+  sema_up (&exited);
+}
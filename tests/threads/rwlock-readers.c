@@ -0,0 +1,118 @@
+/* Measures read throughput through a readers-writer lock against
+   a plain lock with 1, 8 and 64 concurrent readers.
+
+   Each reader takes the lock READ_CNT times and holds it across a
+   one-tick sleep, standing in for a read that has to wait on I/O.
+   Under a plain lock the readers take turns, so the elapsed time
+   grows with the number of readers; under the rwlock they all
+   read at once and it should stay about the same.  A writer then
+   takes the rwlock to make sure the readers left it free. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define READ_CNT 4
+
+/* Smallest tolerated speedup of the rwlock over the plain lock
+   with the most readers. */
+#define MIN_SPEEDUP 8
+
+static const int reader_counts[] = {1, 8, 64};
+#define ROUND_CNT ((int) (sizeof reader_counts / sizeof *reader_counts))
+
+static struct lock lock;
+static struct rwlock rwlock;
+static struct semaphore done;
+
+static thread_func lock_reader;
+static thread_func rwlock_reader;
+static int64_t measure_reads (thread_func *, int reader_cnt);
+
+void
+test_rwlock_readers (void)
+{
+  int64_t lock_ticks[ROUND_CNT], rwlock_ticks[ROUND_CNT];
+  int i;
+
+  lock_init (&lock);
+  rwlock_init (&rwlock);
+  sema_init (&done, 0);
+
+  for (i = 0; i < ROUND_CNT; i++)
+    {
+      int reader_cnt = reader_counts[i];
+
+      lock_ticks[i] = measure_reads (lock_reader, reader_cnt);
+      rwlock_ticks[i] = measure_reads (rwlock_reader, reader_cnt);
+      msg ("%2d readers: %4lld reads/s with lock, %4lld with rwlock.",
+           reader_cnt,
+           (long long) reader_cnt * READ_CNT * TIMER_FREQ / lock_ticks[i],
+           (long long) reader_cnt * READ_CNT * TIMER_FREQ / rwlock_ticks[i]);
+    }
+
+  rwlock_acquire_write (&rwlock);
+  if (!rwlock_held_for_write (&rwlock))
+    fail ("rwlock not held after rwlock_acquire_write().");
+  rwlock_release_write (&rwlock);
+
+  if (rwlock_ticks[ROUND_CNT - 1] * MIN_SPEEDUP > lock_ticks[ROUND_CNT - 1])
+    fail ("rwlock took %lld ticks, lock took %lld.",
+          (long long) rwlock_ticks[ROUND_CNT - 1],
+          (long long) lock_ticks[ROUND_CNT - 1]);
+  pass ();
+}
+
+/* Runs READER_CNT threads executing READER to completion and
+   returns the number of ticks that took. */
+static int64_t
+measure_reads (thread_func *reader, int reader_cnt)
+{
+  int64_t start = timer_ticks ();
+  int64_t elapsed;
+  int i;
+
+  for (i = 0; i < reader_cnt; i++)
+    {
+      char name[24];
+      snprintf (name, sizeof name, "reader %d", i);
+      if (thread_create (name, PRI_DEFAULT, reader, NULL) == TID_ERROR)
+        PANIC ("couldn't create reader");
+    }
+  for (i = 0; i < reader_cnt; i++)
+    sema_down (&done);
+
+  elapsed = timer_elapsed (start);
+  return elapsed > 0 ? elapsed : 1;
+}
+
+static void
+lock_reader (void *aux UNUSED)
+{
+  int i;
+
+  for (i = 0; i < READ_CNT; i++)
+    {
+      lock_acquire (&lock);
+      timer_sleep (1);
+      lock_release (&lock);
+    }
+  sema_up (&done);
+}
+
+static void
+rwlock_reader (void *aux UNUSED)
+{
+  int i;
+
+  for (i = 0; i < READ_CNT; i++)
+    {
+      rwlock_acquire_read (&rwlock);
+      timer_sleep (1);
+      rwlock_release_read (&rwlock);
+    }
+  sema_up (&done);
+}
@@ -19,6 +19,7 @@
 #include "threads/malloc.h"
 #include "threads/mmu.h"
 #include "threads/palloc.h"
+#include "threads/profile.h"
 #include "threads/pte.h"
 #include "threads/thread.h"
 #ifdef USERPROG
@@ -86,6 +87,7 @@ main (void) {
 	mem_end = palloc_init ();
 	malloc_init ();
 	paging_init (mem_end);
+	profile_init ();
 
 #ifdef USERPROG
 	tss_init ();
@@ -221,11 +223,21 @@ parse_options (char **argv) {
 			random_init (atoi (value));
 		else if (!strcmp (name, "-mlfqs"))
 			thread_mlfqs = true;
+		else if (!strcmp (name, "-tickless"))
+			timer_tickless = true;
+		else if (!strcmp (name, "-profile")) {
+			profile_enabled = true;
+			profile_depth = value != NULL ? atoi (value) : 0;
+		}
 #ifdef USERPROG
 		else if (!strcmp (name, "-ul"))
 			user_page_limit = atoi (value);
 		else if (!strcmp (name, "-threads-tests"))
 			thread_tests = true;
+#endif
+#ifdef VM
+		else if (!strcmp (name, "-fa"))
+			fault_around_pages = atoi (value);
 #endif
 		else
 			PANIC ("unknown option `%s' (use -h for help)", name);
@@ -326,8 +338,13 @@ usage (void) {
 			"  -f                 Format file system disk during startup.\n"
 			"  -rs=SEED           Set random number seed to SEED.\n"
 			"  -mlfqs             Use multi-level feedback queue scheduler.\n"
+			"  -tickless          Stop the periodic timer tick while idle.\n"
+			"  -profile[=DEPTH]   Sample code on each tick, with DEPTH callers.\n"
 #ifdef USERPROG
 			"  -ul=COUNT          Limit user memory to COUNT pages.\n"
+#endif
+#ifdef VM
+			"  -fa=PAGES          Map up to PAGES pages around a page fault.\n"
 #endif
 			);
 	power_off ();
@@ -343,6 +360,7 @@ power_off (void) {
 #endif
 
 	print_stats ();
+	profile_dump ();
 
 	printf ("Powering off...\n");
 	outw (0x604, 0x2000);               /* Poweroff command for qemu */
@@ -356,9 +374,18 @@ print_stats (void) {
 	thread_print_stats ();
 #ifdef FILESYS
 	disk_print_stats ();
+#endif
+	palloc_print_stats ();
+	malloc_print_stats ();
+	kmem_print_stats ();
+#ifdef VM
+	vm_print_stats ();
 #endif
 	console_print_stats ();
 	kbd_print_stats ();
+#ifdef LOCK_STATS
+	lock_print_stats ();
+#endif
 #ifdef USERPROG
 	exception_print_stats ();
 #endif
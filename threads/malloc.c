@@ -1,5 +1,6 @@
 #include "threads/malloc.h"
 #include <debug.h>
+#include <inttypes.h>
 #include <list.h>
 #include <round.h>
 #include <stdint.h>
@@ -28,9 +29,19 @@
    blocks, we remove all of the arena's blocks from the free list
    and give the arena back to the page allocator.
 
-   We can't handle blocks bigger than 2 kB using this scheme,
-   because they're too big to fit in a single page with a
-   descriptor.  We handle those by allocating contiguous pages
+   We can't handle blocks bigger than 1 kB using this scheme,
+   because no more than 3 of them fit in a single page with a
+   descriptor.  Requests of up to 16 kB go to "large" descriptors
+   instead, whose sizes grow by steps of 1.5x or 1.33x (1.5 kB,
+   2 kB, 3 kB, 4 kB, 6 kB, ...) and whose arenas span as many
+   pages as it takes to waste no more than 1/8 of them.  Each
+   large block is preceded by a small header that points to its
+   arena, because the block may not lie in the arena's first
+   page.  A large block may also take up several consecutive
+   blocks, or "slots", of its arena, which lets realloc() grow it
+   in place when the slots after it are free.
+
+   Bigger requests are handled by allocating contiguous pages
    with the page allocator and sticking the allocation size at
    the beginning of the allocated block's arena header. */
 
@@ -38,8 +49,12 @@
 struct desc {
 	size_t block_size;          /* Size of each element in bytes. */
 	size_t blocks_per_arena;    /* Number of blocks in an arena. */
+	size_t arena_pages;         /* Number of pages in an arena. */
+	size_t block_ofs;           /* Offset of first block in arena. */
+	size_t slot_size;           /* Distance between blocks in arena. */
 	struct list free_list;      /* List of free blocks. */
 	struct lock lock;           /* Lock. */
+	struct malloc_stats stats;  /* Activity, protected by `lock'. */
 };
 
 /* Magic number for detecting arena corruption. */
@@ -57,26 +72,121 @@ struct block {
 	struct list_elem free_elem; /* Free list element. */
 };
 
+/* Magic number for detecting large block corruption. */
+#define LARGE_MAGIC 0x1a26eb10
+
+/* Header in front of each slot of a large arena.
+
+   Small blocks and big blocks always start 8 bytes past a
+   multiple of 16 within their page, because the arena header is
+   24 bytes long and all small block sizes are multiples of 16.
+   Large blocks start at multiples of 16, which is how free()
+   tells them apart. */
+struct large_hdr {
+	struct arena *arena;        /* Owning arena. */
+	unsigned magic;             /* Always set to LARGE_MAGIC. */
+	unsigned slot_cnt;          /* Slots taken by block, 0 if free. */
+};
+
+/* Largest size handled by a large descriptor. */
+#define LARGE_MAX (16 * 1024)
+
+/* Most pages in a large arena. */
+#define LARGE_ARENA_PAGES 16
+
 /* Our set of descriptors. */
-static struct desc descs[10];   /* Descriptors. */
+static struct desc descs[20];   /* Descriptors. */
 static size_t desc_cnt;         /* Number of descriptors. */
 
+/* Statistics for big blocks. */
+static struct malloc_stats big_stats;
+static struct lock big_stats_lock;
+
+/* Object caches.
+
+   Each cache carves page-sized "slabs" into slots of its own
+   object size, so that an object only wastes the few bytes needed
+   to align it, instead of up to half of a power-of-2 block.  A
+   slab is on one of three lists, according to whether all, some,
+   or none of its objects are free, so that allocation always takes
+   an object from the fullest slabs first and the others get a
+   chance to drain.  A slab whose objects have all been freed is
+   kept for reuse, up to KMEM_EMPTY_MAX of them per cache, and
+   given back to the page allocator otherwise.
+
+   A free object is linked into its slab's free list through a
+   pointer at its start, or just past its end if the cache has a
+   constructor, so as not to overwrite the constructed state. */
+
+/* Magic number for detecting slab corruption. */
+#define SLAB_MAGIC 0x51ab51ab
+
+/* Most empty slabs kept by a cache. */
+#define KMEM_EMPTY_MAX 1
+
+/* Slab header, at the start of each slab's page. */
+struct slab {
+	unsigned magic;             /* Always set to SLAB_MAGIC. */
+	struct kmem_cache *cache;   /* Owning cache. */
+	struct list_elem elem;      /* Element in one of the cache's lists. */
+	size_t used_cnt;            /* Objects in use. */
+	void *free;                 /* First free object. */
+};
+
+/* Offset of the first object in a slab. */
+#define SLAB_OBJ_OFS ROUND_UP (sizeof (struct slab), sizeof (void *))
+
+static struct list caches;      /* All object caches. */
+static struct lock caches_lock; /* Protects `caches'. */
+
 static struct arena *block_to_arena (struct block *);
 static struct block *arena_to_block (struct arena *, size_t idx);
+static bool block_is_large (struct block *);
+static struct large_hdr *block_to_hdr (struct block *);
+static size_t block_to_idx (struct arena *, struct block *);
+static bool large_grow (struct block *, size_t new_size);
+static void large_init_desc (struct desc *, size_t block_size);
+static void count_alloc (struct malloc_stats *, size_t requested,
+		size_t granted);
+static struct slab *slab_create (struct kmem_cache *);
+static struct slab *obj_to_slab (struct kmem_cache *, void *);
+static void **obj_link (struct kmem_cache *, void *);
+static size_t malloc_page_cnt (size_t size, size_t cnt);
 
 /* Initializes the malloc() descriptors. */
 void
 malloc_init (void) {
 	size_t block_size;
 
+	ASSERT (sizeof (struct arena) % 16 == 8);
+	ASSERT (sizeof (struct large_hdr) == 16);
+
 	for (block_size = 16; block_size < PGSIZE / 2; block_size *= 2) {
 		struct desc *d = &descs[desc_cnt++];
+		char name[16];
 		ASSERT (desc_cnt <= sizeof descs / sizeof *descs);
 		d->block_size = block_size;
 		d->blocks_per_arena = (PGSIZE - sizeof (struct arena)) / block_size;
+		d->arena_pages = 1;
+		d->block_ofs = sizeof (struct arena);
+		d->slot_size = block_size;
 		list_init (&d->free_list);
-		lock_init (&d->lock);
+		snprintf (name, sizeof name, "malloc %zu", block_size);
+		lock_init_named (&d->lock, name);
+	}
+
+	/* Large descriptors: 1.5 kB, 2 kB, 3 kB, 4 kB, 6 kB, ... */
+	for (block_size = PGSIZE / 2 * 3 / 4; block_size <= LARGE_MAX;
+			block_size = (block_size & (block_size - 1)) == 0
+			? block_size / 2 * 3 : block_size / 3 * 4) {
+		struct desc *d = &descs[desc_cnt++];
+		ASSERT (desc_cnt <= sizeof descs / sizeof *descs);
+		large_init_desc (d, block_size);
 	}
+	lock_init (&big_stats_lock);
+
+	list_init (&caches);
+	lock_init (&caches_lock);
 }
 
 /* Obtains and returns a new block of at least SIZE bytes.
@@ -104,6 +214,10 @@ malloc (size_t size) {
 		if (a == NULL)
 			return NULL;
 
+		lock_acquire (&big_stats_lock);
+		count_alloc (&big_stats, size, page_cnt * PGSIZE - sizeof *a);
+		lock_release (&big_stats_lock);
+
 		/* Initialize the arena to indicate a big block of PAGE_CNT
 		   pages, and return it. */
 		a->magic = ARENA_MAGIC;
@@ -119,7 +233,7 @@ malloc (size_t size) {
 		size_t i;
 
 		/* Allocate a page. */
-		a = palloc_get_page (0);
+		a = palloc_get_multiple (0, d->arena_pages);
 		if (a == NULL) {
 			lock_release (&d->lock);
 			return NULL;
@@ -131,6 +245,12 @@ malloc (size_t size) {
 		a->free_cnt = d->blocks_per_arena;
 		for (i = 0; i < d->blocks_per_arena; i++) {
 			struct block *b = arena_to_block (a, i);
+			if (block_is_large (b)) {
+				struct large_hdr *h = (struct large_hdr *) b - 1;
+				h->arena = a;
+				h->magic = LARGE_MAGIC;
+				h->slot_cnt = 0;
+			}
 			list_push_back (&d->free_list, &b->free_elem);
 		}
 	}
@@ -139,6 +259,9 @@ malloc (size_t size) {
 	b = list_entry (list_pop_front (&d->free_list), struct block, free_elem);
 	a = block_to_arena (b);
 	a->free_cnt--;
+	if (block_is_large (b))
+		block_to_hdr (b)->slot_cnt = 1;
+	count_alloc (&d->stats, size, d->block_size);
 	lock_release (&d->lock);
 	return b;
 }
@@ -170,7 +293,13 @@ block_size (void *block) {
 	struct arena *a = block_to_arena (b);
 	struct desc *d = a->desc;
 
-	return d != NULL ? d->block_size : PGSIZE * a->free_cnt - pg_ofs (block);
+	if (d == NULL)
+		return PGSIZE * a->free_cnt - pg_ofs (block);
+	else if (block_is_large (b))
+		return block_to_hdr (b)->slot_cnt * d->slot_size
+			- sizeof (struct large_hdr);
+	else
+		return d->block_size;
 }
 
 /* Attempts to resize OLD_BLOCK to NEW_SIZE bytes, possibly
@@ -178,12 +307,20 @@ block_size (void *block) {
    If successful, returns the new block; on failure, returns a
    null pointer.
    A call with null OLD_BLOCK is equivalent to malloc(NEW_SIZE).
-   A call with zero NEW_SIZE is equivalent to free(OLD_BLOCK). */
+   A call with zero NEW_SIZE is equivalent to free(OLD_BLOCK).
+   OLD_BLOCK stays in place if it already has room for NEW_SIZE
+   bytes, or if it is a large block that can take over the free
+   slots that follow it. */
 void *
 realloc (void *old_block, size_t new_size) {
 	if (new_size == 0) {
 		free (old_block);
 		return NULL;
+	} else if (old_block != NULL
+			&& (new_size <= block_size (old_block)
+				|| (block_is_large (old_block)
+					&& large_grow (old_block, new_size)))) {
+		return old_block;
 	} else {
 		void *new_block = malloc (new_size);
 		if (old_block != NULL && new_block != NULL) {
@@ -206,28 +343,46 @@ free (void *p) {
 		struct desc *d = a->desc;
 
 		if (d != NULL) {
-			/* It's a normal block.  We handle it here. */
+			/* It's a normal block.  We handle it here.
+			   A large block may take up several slots, each of
+			   which becomes a free block again. */
+			size_t slot_cnt = 1;
+			size_t i;
+
+			if (block_is_large (b)) {
+				slot_cnt = block_to_hdr (b)->slot_cnt;
+				ASSERT (slot_cnt > 0);
+			}
 
 #ifndef NDEBUG
 			/* Clear the block to help detect use-after-free bugs. */
-			memset (b, 0xcc, d->block_size);
+			memset (b, 0xcc, block_size (b));
 #endif
 
 			lock_acquire (&d->lock);
 
-			/* Add block to free list. */
-			list_push_front (&d->free_list, &b->free_elem);
+			/* Add the block's slots to the free list. */
+			for (i = 0; i < slot_cnt; i++) {
+				struct block *slot = (struct block *) ((uint8_t *) b
+						+ i * d->slot_size);
+				if (block_is_large (slot)) {
+					struct large_hdr *h = (struct large_hdr *) slot - 1;
+					h->arena = a;
+					h->magic = LARGE_MAGIC;
+					h->slot_cnt = 0;
+				}
+				list_push_front (&d->free_list, &slot->free_elem);
+			}
 
 			/* If the arena is now entirely unused, free it. */
-			if (++a->free_cnt >= d->blocks_per_arena) {
-				size_t i;
-
+			a->free_cnt += slot_cnt;
+			if (a->free_cnt >= d->blocks_per_arena) {
 				ASSERT (a->free_cnt == d->blocks_per_arena);
 				for (i = 0; i < d->blocks_per_arena; i++) {
 					struct block *b = arena_to_block (a, i);
 					list_remove (&b->free_elem);
 				}
-				palloc_free_page (a);
+				palloc_free_multiple (a, d->arena_pages);
 			}
 
 			lock_release (&d->lock);
@@ -238,11 +393,361 @@ free (void *p) {
 		}
 	}
 }
-
+
+/* Prints malloc() statistics: for each descriptor and for big
+   blocks, the number of allocations and the share of the bytes
+   they were granted that went unrequested. */
+void
+malloc_print_stats (void) {
+	struct malloc_stats total = big_stats;
+	struct desc *d;
+
+	for (d = descs; d < descs + desc_cnt; d++) {
+		if (d->stats.alloc_cnt == 0)
+			continue;
+		printf ("Malloc %zu: %"PRIu64" allocations, %"PRIu64"%% unused\n",
+				d->block_size, d->stats.alloc_cnt,
+				(d->stats.granted - d->stats.requested) * 100
+				/ d->stats.granted);
+		total.alloc_cnt += d->stats.alloc_cnt;
+		total.requested += d->stats.requested;
+		total.granted += d->stats.granted;
+	}
+	if (big_stats.alloc_cnt > 0)
+		printf ("Malloc big: %"PRIu64" allocations, %"PRIu64"%% unused\n",
+				big_stats.alloc_cnt,
+				(big_stats.granted - big_stats.requested) * 100
+				/ big_stats.granted);
+	if (total.alloc_cnt > 0)
+		printf ("Malloc: %"PRIu64" bytes requested, %"PRIu64" granted, "
+				"%"PRIu64"%% internal fragmentation\n",
+				total.requested, total.granted,
+				(total.granted - total.requested) * 100 / total.granted);
+}
+
+/* Returns the stats of the descriptor for BLOCK_SIZE-byte
+   blocks, or those of big blocks if BLOCK_SIZE is too big for any
+   descriptor, in *STATS. */
+void
+malloc_get_stats (size_t block_size, struct malloc_stats *stats) {
+	struct desc *d;
+
+	for (d = descs; d < descs + desc_cnt; d++)
+		if (d->block_size >= block_size) {
+			lock_acquire (&d->lock);
+			*stats = d->stats;
+			lock_release (&d->lock);
+			return;
+		}
+	lock_acquire (&big_stats_lock);
+	*stats = big_stats;
+	lock_release (&big_stats_lock);
+}
+
+/* Sets up D as the large descriptor for BLOCK_SIZE-byte blocks,
+   with an arena of the fewest pages that wastes no more than 1/8
+   of them. */
+static void
+large_init_desc (struct desc *d, size_t block_size) {
+	char name[32];
+
+	ASSERT (block_size % 16 == 0);
+
+	d->block_size = block_size;
+	d->block_ofs = ROUND_UP (sizeof (struct arena), 16)
+		+ sizeof (struct large_hdr);
+	d->slot_size = block_size + sizeof (struct large_hdr);
+	for (d->arena_pages = 1; ; d->arena_pages++) {
+		size_t arena_size = d->arena_pages * PGSIZE;
+
+		d->blocks_per_arena = (arena_size - d->block_ofs + d->slot_size
+				- block_size) / d->slot_size;
+		if ((arena_size - d->blocks_per_arena * block_size) * 8 <= arena_size
+				|| d->arena_pages == LARGE_ARENA_PAGES)
+			break;
+	}
+	ASSERT (d->blocks_per_arena > 1);
+
+	list_init (&d->free_list);
+	snprintf (name, sizeof name, "malloc %zu", block_size);
+	lock_init_named (&d->lock, name);
+}
+
+/* Tries to grow large block B in place to NEW_SIZE bytes, by
+   taking over the free slots that follow it in its arena.
+   Returns true if successful, false if B stays as it was. */
+static bool
+large_grow (struct block *b, size_t new_size) {
+	struct large_hdr *h = block_to_hdr (b);
+	struct arena *a = h->arena;
+	struct desc *d = a->desc;
+	size_t idx = block_to_idx (a, b);
+	size_t slot_cnt = DIV_ROUND_UP (new_size + sizeof *h, d->slot_size);
+	size_t i;
+
+	if (idx + slot_cnt > d->blocks_per_arena)
+		return false;
+
+	lock_acquire (&d->lock);
+	for (i = idx + h->slot_cnt; i < idx + slot_cnt; i++)
+		if (block_to_hdr (arena_to_block (a, i))->slot_cnt != 0) {
+			lock_release (&d->lock);
+			return false;
+		}
+	for (i = idx + h->slot_cnt; i < idx + slot_cnt; i++)
+		list_remove (&arena_to_block (a, i)->free_elem);
+	a->free_cnt -= slot_cnt - h->slot_cnt;
+	h->slot_cnt = slot_cnt;
+	count_alloc (&d->stats, new_size, slot_cnt * d->slot_size - sizeof *h);
+	lock_release (&d->lock);
+	return true;
+}
+
+/* Adds an allocation of REQUESTED bytes that was granted GRANTED
+   bytes to STATS. */
+static void
+count_alloc (struct malloc_stats *stats, size_t requested, size_t granted) {
+	stats->alloc_cnt++;
+	stats->requested += requested;
+	stats->granted += granted;
+}
+
+/* Initializes CACHE to hand out objects of SIZE bytes, with
+   constructor CTOR if it is nonnull.  NAME identifies the cache
+   in statistics. */
+void
+kmem_cache_init (struct kmem_cache *cache, const char *name, size_t size,
+		void (*ctor) (void *)) {
+	ASSERT (cache != NULL);
+	ASSERT (size > 0);
+
+	strlcpy (cache->name, name, sizeof cache->name);
+	cache->obj_size = ROUND_UP (size, sizeof (void *));
+	cache->link_ofs = ctor != NULL ? cache->obj_size : 0;
+	cache->slot_size = cache->link_ofs + sizeof (void *);
+	if (cache->slot_size < cache->obj_size)
+		cache->slot_size = cache->obj_size;
+	cache->objs_per_slab = (PGSIZE - SLAB_OBJ_OFS) / cache->slot_size;
+	cache->ctor = ctor;
+	ASSERT (cache->objs_per_slab > 0);
+
+	lock_init_named (&cache->lock, cache->name);
+	list_init (&cache->partial_slabs);
+	list_init (&cache->full_slabs);
+	list_init (&cache->empty_slabs);
+	cache->empty_cnt = 0;
+	cache->obj_cnt = cache->peak_obj_cnt = 0;
+	cache->slab_cnt = cache->peak_slab_cnt = 0;
+
+	lock_acquire (&caches_lock);
+	list_push_back (&caches, &cache->elem);
+	lock_release (&caches_lock);
+}
+
+/* Obtains and returns an object from CACHE, in its constructed
+   state if CACHE has a constructor.  Returns a null pointer if
+   memory is not available. */
+void *
+kmem_cache_alloc (struct kmem_cache *cache) {
+	struct slab *s;
+	void *obj;
+
+	lock_acquire (&cache->lock);
+
+	/* Find a slab with a free object, preferring partly used
+	   slabs to empty ones and empty ones to a new one. */
+	if (list_empty (&cache->partial_slabs)) {
+		if (!list_empty (&cache->empty_slabs)) {
+			s = list_entry (list_pop_front (&cache->empty_slabs),
+					struct slab, elem);
+			cache->empty_cnt--;
+		} else {
+			s = slab_create (cache);
+			if (s == NULL) {
+				lock_release (&cache->lock);
+				return NULL;
+			}
+		}
+		list_push_front (&cache->partial_slabs, &s->elem);
+	}
+	s = list_entry (list_front (&cache->partial_slabs), struct slab, elem);
+
+	/* Take its first free object. */
+	obj = s->free;
+	s->free = *obj_link (cache, obj);
+	if (++s->used_cnt == cache->objs_per_slab) {
+		list_remove (&s->elem);
+		list_push_front (&cache->full_slabs, &s->elem);
+	}
+	if (++cache->obj_cnt > cache->peak_obj_cnt)
+		cache->peak_obj_cnt = cache->obj_cnt;
+
+	lock_release (&cache->lock);
+	return obj;
+}
+
+/* Returns OBJ, which must have been obtained from CACHE with
+   kmem_cache_alloc(), to CACHE.  If CACHE has a constructor, OBJ
+   must be in its constructed state.  A null OBJ is ignored. */
+void
+kmem_cache_free (struct kmem_cache *cache, void *obj) {
+	struct slab *s;
+
+	if (obj == NULL)
+		return;
+	s = obj_to_slab (cache, obj);
+
+#ifndef NDEBUG
+	/* Clear the object to help detect use-after-free bugs.
+	   Constructed objects must keep their contents. */
+	if (cache->ctor == NULL)
+		memset (obj, 0xcc, cache->obj_size);
+#endif
+
+	lock_acquire (&cache->lock);
+
+	*obj_link (cache, obj) = s->free;
+	s->free = obj;
+	if (s->used_cnt-- == cache->objs_per_slab) {
+		list_remove (&s->elem);
+		list_push_front (&cache->partial_slabs, &s->elem);
+	}
+	cache->obj_cnt--;
+
+	/* Keep the slab for reuse if it is now empty and we have few
+	   empty slabs, otherwise give it back. */
+	if (s->used_cnt == 0) {
+		list_remove (&s->elem);
+		if (cache->empty_cnt < KMEM_EMPTY_MAX) {
+			list_push_front (&cache->empty_slabs, &s->elem);
+			cache->empty_cnt++;
+		} else {
+			s->magic = 0;
+			palloc_free_page (s);
+			cache->slab_cnt--;
+		}
+	}
+
+	lock_release (&cache->lock);
+}
+
+/* Prints statistics for each object cache, including the pages
+   that the same objects would have taken at least with malloc(). */
+void
+kmem_print_stats (void) {
+	struct list_elem *e;
+
+	lock_acquire (&caches_lock);
+	for (e = list_begin (&caches); e != list_end (&caches); e = list_next (e)) {
+		struct kmem_cache *c = list_entry (e, struct kmem_cache, elem);
+
+		if (c->peak_obj_cnt == 0)
+			continue;
+		printf ("Cache %s: %zu-byte objects, peak %zu in %zu pages "
+				"(malloc: %zu pages)\n",
+				c->name, c->obj_size, c->peak_obj_cnt, c->peak_slab_cnt,
+				malloc_page_cnt (c->obj_size, c->peak_obj_cnt));
+	}
+	lock_release (&caches_lock);
+}
+
+/* Allocates a slab for CACHE and builds its free list, running
+   the constructor on each object.  Returns the slab, or a null
+   pointer if memory is not available. */
+static struct slab *
+slab_create (struct kmem_cache *cache) {
+	struct slab *s;
+	size_t i;
+
+	ASSERT (lock_held_by_current_thread (&cache->lock));
+
+	s = palloc_get_page (0);
+	if (s == NULL)
+		return NULL;
+
+	s->magic = SLAB_MAGIC;
+	s->cache = cache;
+	s->used_cnt = 0;
+	s->free = NULL;
+	for (i = cache->objs_per_slab; i-- > 0; ) {
+		void *obj = (uint8_t *) s + SLAB_OBJ_OFS + i * cache->slot_size;
+
+		if (cache->ctor != NULL)
+			cache->ctor (obj);
+		*obj_link (cache, obj) = s->free;
+		s->free = obj;
+	}
+
+	if (++cache->slab_cnt > cache->peak_slab_cnt)
+		cache->peak_slab_cnt = cache->slab_cnt;
+	return s;
+}
+
+/* Returns the slab of CACHE that OBJ is inside. */
+static struct slab *
+obj_to_slab (struct kmem_cache *cache UNUSED, void *obj) {
+	struct slab *s = pg_round_down (obj);
+
+	/* Check that the slab is valid and belongs to CACHE. */
+	ASSERT (s != NULL);
+	ASSERT (s->magic == SLAB_MAGIC);
+	ASSERT (s->cache == cache);
+
+	/* Check that the object is properly aligned for the slab. */
+	ASSERT (pg_ofs (obj) >= SLAB_OBJ_OFS);
+	ASSERT ((pg_ofs (obj) - SLAB_OBJ_OFS) % cache->slot_size == 0);
+
+	return s;
+}
+
+/* Returns the free list link of OBJ, an object of CACHE. */
+static void **
+obj_link (struct kmem_cache *cache, void *obj) {
+	return (void **) ((uint8_t *) obj + cache->link_ofs);
+}
+
+/* Returns the number of pages that malloc() needs at least for
+   CNT blocks of SIZE bytes. */
+static size_t
+malloc_page_cnt (size_t size, size_t cnt) {
+	struct desc *d;
+
+	for (d = descs; d < descs + desc_cnt; d++)
+		if (d->block_size >= size)
+			return DIV_ROUND_UP (cnt, d->blocks_per_arena) * d->arena_pages;
+	return cnt * DIV_ROUND_UP (size + sizeof (struct arena), PGSIZE);
+}
+
+/* Returns true if B is a block of a large arena. */
+static bool
+block_is_large (struct block *b) {
+	return pg_ofs (b) % 16 == 0;
+}
+
+/* Returns the header of large block B. */
+static struct large_hdr *
+block_to_hdr (struct block *b) {
+	struct large_hdr *h = (struct large_hdr *) b - 1;
+
+	ASSERT (block_is_large (b));
+	ASSERT (h->magic == LARGE_MAGIC);
+	return h;
+}
+
+/* Returns the index of block B within arena A. */
+static size_t
+block_to_idx (struct arena *a, struct block *b) {
+	size_t ofs = (uint8_t *) b - (uint8_t *) a - a->desc->block_ofs;
+
+	ASSERT (ofs % a->desc->slot_size == 0);
+	return ofs / a->desc->slot_size;
+}
+
 /* Returns the arena that block B is inside. */
 static struct arena *
 block_to_arena (struct block *b) {
-	struct arena *a = pg_round_down (b);
+	struct arena *a = (block_is_large (b) ? block_to_hdr (b)->arena
+			: pg_round_down (b));
 
 	/* Check that the arena is valid. */
 	ASSERT (a != NULL);
@@ -250,7 +755,8 @@ block_to_arena (struct block *b) {
 
 	/* Check that the block is properly aligned for the arena. */
 	ASSERT (a->desc == NULL
-			|| (pg_ofs (b) - sizeof *a) % a->desc->block_size == 0);
+			|| ((uint8_t *) b - (uint8_t *) a - a->desc->block_ofs)
+			% a->desc->slot_size == 0);
 	ASSERT (a->desc != NULL || pg_ofs (b) == sizeof *a);
 
 	return a;
@@ -263,6 +769,6 @@ arena_to_block (struct arena *a, size_t idx) {
 	ASSERT (a->magic == ARENA_MAGIC);
 	ASSERT (idx < a->desc->blocks_per_arena);
 	return (struct block *) ((uint8_t *) a
-			+ sizeof *a
-			+ idx * a->desc->block_size);
+			+ a->desc->block_ofs
+			+ idx * a->desc->slot_size);
 }
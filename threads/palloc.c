@@ -2,14 +2,16 @@
 #include <bitmap.h>
 #include <debug.h>
 #include <inttypes.h>
+#include <list.h>
 #include <round.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 #include "threads/init.h"
+#include "threads/interrupt.h"
 #include "threads/loader.h"
-#include "threads/synch.h"
+#include "threads/thread.h"
 #include "threads/vaddr.h"
 
 /* Page allocator.  Hands out memory in page-size (or
@@ -24,13 +26,66 @@
 
    By default, half of system RAM is given to the kernel pool and
    half to the user pool.  That should be huge overkill for the
-   kernel pool, but that's just fine for demonstration purposes. */
+   kernel pool, but that's just fine for demonstration purposes.
+
+   Within a pool, free pages are managed by a binary buddy
+   allocator.  Free memory is kept as blocks of 2**ORDER pages,
+   each aligned to its own size relative to the pool base, on one
+   free list per order.  An allocation takes a block of the
+   smallest sufficient order, splitting a larger one if needed,
+   and gives back any pages beyond the requested count.  A freed
+   block is merged with its "buddy", the other half of the block
+   of the next order up, for as long as that buddy is free too.
+   Both take O(log n) time.
+
+   Pages are also freed by the scheduler, with interrupts off, so
+   the pools are protected by turning interrupts off rather than
+   by a lock.  Every operation on them is short.
+
+   In front of the pools, each thread keeps a small "magazine" of
+   single pages it freed recently, one per pool, so that a thread
+   that frees and allocates pages in turn rarely has to touch the
+   pool.  An empty magazine is refilled, and a full one drained,
+   PALLOC_MAG_BATCH pages at a time.  When a dying thread's page
+   is freed, the thread freeing it takes over the pages in the
+   dying thread's magazines.  An allocation that finds its pool
+   empty drains every thread's magazine for the pool, so that
+   pages cached by other threads, even blocked ones, are not lost
+   to it.
+
+   Finally, the idle thread uses spare time to zero free pages
+   ahead of need, keeping up to PALLOC_ZERO_TARGET of them per
+   pool on a separate "zeroed" list, so that single-page PAL_ZERO
+   requests usually need not touch the page at all.  Zeroed pages
+   are given back to the pool if it runs dry. */
+
+/* Number of zeroed pages the idle thread keeps ready per pool. */
+#define PALLOC_ZERO_TARGET 64
+
+/* Number of pages moved between a magazine and its pool at once. */
+#define PALLOC_MAG_BATCH (PALLOC_MAG_SIZE / 2)
+
+/* Number of block orders, so the largest block is
+   2**(PALLOC_ORDERS - 1) pages. */
+#define PALLOC_ORDERS 21
+
+/* Buddy allocator state of a page. */
+struct page_info {
+	struct list_elem free_elem;     /* Element in a free list. */
+	int8_t order;                   /* If the page starts a free block,
+	                                   the block's order, otherwise -1. */
+};
 
 /* A memory pool. */
 struct pool {
-	struct lock lock;               /* Mutual exclusion. */
-	struct bitmap *used_map;        /* Bitmap of free pages. */
+	struct bitmap *used_map;        /* Bitmap of pages in use. */
+	struct page_info *pages;        /* State of each page. */
+	struct list free_lists[PALLOC_ORDERS]; /* Free blocks, by order. */
+	size_t page_cnt;                /* Number of pages. */
 	uint8_t *base;                  /* Base of pool. */
+	struct list zeroed;             /* Zeroed pages, by `free_elem'. */
+	size_t zeroed_cnt;              /* Number of zeroed pages. */
+	struct palloc_stats stats;      /* Activity. */
 };
 
 /* Two pools: one for kernel data, one for user pages. */
@@ -38,10 +93,30 @@ static struct pool kernel_pool, user_pool;
 
 /* Maximum number of pages to put in user pool. */
 size_t user_page_limit = SIZE_MAX;
+
+/* Cache single pages in per-thread magazines? */
+bool palloc_magazines = true;
 static void
 init_pool (struct pool *p, void **bm_base, uint64_t start, uint64_t end);
 
 static bool page_from_pool (const struct pool *, void *page);
+static struct pool *pool_of (void *page);
+static size_t pool_get (struct pool *, size_t page_cnt);
+static size_t pool_alloc (struct pool *, int order);
+static void *zeroed_get (struct pool *);
+static void zeroed_release (struct pool *);
+static bool zero_pages (struct pool *);
+static void pool_put (struct pool *, size_t page_idx, size_t page_cnt);
+static void *magazine_get (struct pool *);
+static void magazine_put (struct pool *, void *page);
+static void magazine_push (struct pool *, struct palloc_magazine *,
+		void *page);
+static void magazine_drain (struct pool *, struct palloc_magazine *,
+		size_t page_cnt);
+static void magazine_drain_all (struct pool *);
+static size_t buddy_alloc (struct pool *, int order);
+static void buddy_free (struct pool *, size_t page_idx, size_t page_cnt);
+static void buddy_free_block (struct pool *, size_t page_idx, int order);
 
 /* multiboot info */
 struct multiboot_info {
@@ -219,16 +294,18 @@ split:
 			else
 				NOT_REACHED ();
 
-			pool_end = pool->base + bitmap_size (pool->used_map) * PGSIZE;
+			pool_end = pool->base + pool->page_cnt * PGSIZE;
 			page_idx = pg_no (start) - pg_no (pool->base);
 			if ((uint64_t) pool_end < end) {
 				page_cnt = ((uint64_t) pool_end - start) / PGSIZE;
 				bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+				buddy_free (pool, page_idx, page_cnt);
 				start = (uint64_t) pool_end;
 				goto split;
 			} else {
 				page_cnt = ((uint64_t) end - start) / PGSIZE;
 				bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+				buddy_free (pool, page_idx, page_cnt);
 			}
 		}
 	}
@@ -262,16 +339,32 @@ palloc_init (void) {
 void *
 palloc_get_multiple (enum palloc_flags flags, size_t page_cnt) {
 	struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
-
-	lock_acquire (&pool->lock);
-	size_t page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
-	lock_release (&pool->lock);
+	size_t page_idx;
 	void *pages;
 
-	if (page_idx != BITMAP_ERROR)
-		pages = pool->base + PGSIZE * page_idx;
-	else
-		pages = NULL;
+	if (page_cnt == 1 && (flags & PAL_ZERO)
+			&& (pages = zeroed_get (pool)) != NULL)
+		return pages;
+
+	/* If the pool is empty, maybe the pages that threads are
+	   holding on to in their magazines would help. */
+	if (page_cnt == 1 && palloc_magazines) {
+		pages = magazine_get (pool);
+		if (pages == NULL) {
+			magazine_drain_all (pool);
+			pages = magazine_get (pool);
+		}
+	} else {
+		page_idx = pool_get (pool, page_cnt);
+		if (page_idx == BITMAP_ERROR && palloc_magazines) {
+			magazine_drain_all (pool);
+			page_idx = pool_get (pool, page_cnt);
+		}
+		if (page_idx != BITMAP_ERROR)
+			pages = pool->base + PGSIZE * page_idx;
+		else
+			pages = NULL;
+	}
 
 	if (pages) {
 		if (flags & PAL_ZERO)
@@ -300,26 +393,20 @@ palloc_get_page (enum palloc_flags flags) {
 void
 palloc_free_multiple (void *pages, size_t page_cnt) {
 	struct pool *pool;
-	size_t page_idx;
 
 	ASSERT (pg_ofs (pages) == 0);
 	if (pages == NULL || page_cnt == 0)
 		return;
 
-	if (page_from_pool (&kernel_pool, pages))
-		pool = &kernel_pool;
-	else if (page_from_pool (&user_pool, pages))
-		pool = &user_pool;
-	else
-		NOT_REACHED ();
-
-	page_idx = pg_no (pages) - pg_no (pool->base);
+	pool = pool_of (pages);
 
 #ifndef NDEBUG
 	memset (pages, 0xcc, PGSIZE * page_cnt);
 #endif
-	ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
-	bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+	if (page_cnt == 1 && palloc_magazines)
+		magazine_put (pool, pages);
+	else
+		pool_put (pool, pg_no (pages) - pg_no (pool->base), page_cnt);
 }
 
 /* Frees the page at PAGE. */
@@ -328,23 +415,88 @@ palloc_free_page (void *page) {
 	palloc_free_multiple (page, 1);
 }
 
+/* Moves the pages cached in dying thread T's magazines into the
+   current thread's, returning any that do not fit to their pools.
+   Called with interrupts off when T's page is about to be freed. */
+void
+palloc_reclaim_magazines (struct thread *t) {
+	struct thread *curr = thread_current ();
+	size_t i;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+	ASSERT (t != curr);
+
+	for (i = 0; i < t->page_mags[0].cnt; i++)
+		magazine_push (&kernel_pool, &curr->page_mags[0], t->page_mags[0].pages[i]);
+	for (i = 0; i < t->page_mags[1].cnt; i++)
+		magazine_push (&user_pool, &curr->page_mags[1], t->page_mags[1].pages[i]);
+	t->page_mags[0].cnt = t->page_mags[1].cnt = 0;
+}
+
+/* Copies the activity counters of the pool that FLAGS selects,
+   as for palloc_get_page(), into *STATS. */
+void
+palloc_get_stats (enum palloc_flags flags, struct palloc_stats *stats) {
+	struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
+	enum intr_level old_level = intr_disable ();
+
+	*stats = pool->stats;
+	intr_set_level (old_level);
+}
+
+/* Prints page allocator statistics. */
+void
+palloc_print_stats (void) {
+	printf ("Pages: kernel pool %"PRIu64" trips, %"PRIu64" magazine hits, "
+			"%"PRIu64" pre-zeroed; user pool %"PRIu64" trips, "
+			"%"PRIu64" magazine hits, %"PRIu64" pre-zeroed\n",
+			kernel_pool.stats.pool_trips, kernel_pool.stats.magazine_hits,
+			kernel_pool.stats.zeroed_hits, user_pool.stats.pool_trips,
+			user_pool.stats.magazine_hits, user_pool.stats.zeroed_hits);
+}
+
+/* Zeroes free pages into the pools' zeroed lists until each holds
+   PALLOC_ZERO_TARGET pages or runs out of free pages.  Returns
+   true if it zeroed any page.  Called by the idle thread with
+   interrupts on, so that any thread that wakes up meanwhile
+   preempts it. */
+bool
+palloc_zero_idle (void) {
+	bool kernel_zeroed, user_zeroed;
+
+	ASSERT (intr_get_level () == INTR_ON);
+
+	kernel_zeroed = zero_pages (&kernel_pool);
+	user_zeroed = zero_pages (&user_pool);
+	return kernel_zeroed || user_zeroed;
+}
+
 /* Initializes pool P as starting at START and ending at END */
 static void
 init_pool (struct pool *p, void **bm_base, uint64_t start, uint64_t end) {
-  /* We'll put the pool's used_map at its base.
-     Calculate the space needed for the bitmap
-     and subtract it from the pool's size. */
+  /* We'll put the pool's used_map and page array at *BM_BASE.
+     Calculate the space needed for them and advance *BM_BASE
+     past it. */
 	uint64_t pgcnt = (end - start) / PGSIZE;
 	size_t bm_pages = DIV_ROUND_UP (bitmap_buf_size (pgcnt), PGSIZE) * PGSIZE;
+	size_t info_pages = DIV_ROUND_UP (pgcnt * sizeof *p->pages, PGSIZE) * PGSIZE;
+	size_t i;
 
-	lock_init(&p->lock);
 	p->used_map = bitmap_create_in_buf (pgcnt, *bm_base, bm_pages);
+	p->pages = *bm_base + bm_pages;
+	p->page_cnt = pgcnt;
 	p->base = (void *) start;
 
 	// Mark all to unusable.
 	bitmap_set_all(p->used_map, true);
-
-	*bm_base += bm_pages;
+	for (i = 0; i < pgcnt; i++)
+		p->pages[i].order = -1;
+	for (i = 0; i < PALLOC_ORDERS; i++)
+		list_init (&p->free_lists[i]);
+	list_init (&p->zeroed);
+	p->zeroed_cnt = 0;
+
+	*bm_base += bm_pages + info_pages;
 }
 
 /* Returns true if PAGE was allocated from POOL,
@@ -353,6 +505,317 @@ static bool
 page_from_pool (const struct pool *pool, void *page) {
 	size_t page_no = pg_no (page);
 	size_t start_page = pg_no (pool->base);
-	size_t end_page = start_page + bitmap_size (pool->used_map);
+	size_t end_page = start_page + pool->page_cnt;
 	return page_no >= start_page && page_no < end_page;
 }
+
+/* Returns the pool that PAGE belongs to. */
+static struct pool *
+pool_of (void *page) {
+	if (page_from_pool (&kernel_pool, page))
+		return &kernel_pool;
+	else if (page_from_pool (&user_pool, page))
+		return &user_pool;
+	else
+		NOT_REACHED ();
+}
+
+/* Takes PAGE_CNT contiguous pages out of POOL and returns the
+   index of the first, or BITMAP_ERROR if there is no such run. */
+static size_t
+pool_get (struct pool *pool, size_t page_cnt) {
+	enum intr_level old_level;
+	size_t page_idx;
+	int order;
+
+	/* Smallest order that holds PAGE_CNT pages. */
+	for (order = 0; order < PALLOC_ORDERS; order++)
+		if ((size_t) 1 << order >= page_cnt)
+			break;
+	if (page_cnt == 0 || order == PALLOC_ORDERS)
+		return BITMAP_ERROR;
+
+	old_level = intr_disable ();
+	pool->stats.pool_trips++;
+	page_idx = pool_alloc (pool, order);
+	if (page_idx != BITMAP_ERROR) {
+		/* Give back the pages we don't need. */
+		buddy_free (pool, page_idx + page_cnt,
+				((size_t) 1 << order) - page_cnt);
+		ASSERT (!bitmap_any (pool->used_map, page_idx, page_cnt));
+		bitmap_set_multiple (pool->used_map, page_idx, page_cnt, true);
+	}
+	intr_set_level (old_level);
+	return page_idx;
+}
+
+/* Returns the PAGE_CNT pages starting at PAGE_IDX to POOL. */
+static void
+pool_put (struct pool *pool, size_t page_idx, size_t page_cnt) {
+	enum intr_level old_level = intr_disable ();
+
+	pool->stats.pool_trips++;
+	ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
+	bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+	buddy_free (pool, page_idx, page_cnt);
+	intr_set_level (old_level);
+}
+
+/* Removes a free block of 2**ORDER pages from POOL, as
+   buddy_alloc() does, giving the zeroed pages back to the free
+   lists first if there is no such block otherwise. */
+static size_t
+pool_alloc (struct pool *pool, int order) {
+	size_t page_idx = buddy_alloc (pool, order);
+
+	if (page_idx == BITMAP_ERROR && pool->zeroed_cnt > 0) {
+		zeroed_release (pool);
+		page_idx = buddy_alloc (pool, order);
+	}
+	return page_idx;
+}
+
+/* Takes a page off POOL's zeroed list and returns it, or returns
+   a null pointer if the list is empty. */
+static void *
+zeroed_get (struct pool *pool) {
+	enum intr_level old_level = intr_disable ();
+	void *page = NULL;
+
+	if (pool->zeroed_cnt > 0) {
+		struct page_info *info = list_entry (list_pop_front (&pool->zeroed),
+				struct page_info, free_elem);
+
+		pool->zeroed_cnt--;
+		pool->stats.zeroed_hits++;
+		page = pool->base + PGSIZE * (info - pool->pages);
+	}
+	intr_set_level (old_level);
+	return page;
+}
+
+/* Returns all of POOL's zeroed pages to its free lists. */
+static void
+zeroed_release (struct pool *pool) {
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	while (!list_empty (&pool->zeroed)) {
+		struct page_info *info = list_entry (list_pop_front (&pool->zeroed),
+				struct page_info, free_elem);
+		size_t page_idx = info - pool->pages;
+
+		bitmap_reset (pool->used_map, page_idx);
+		buddy_free (pool, page_idx, 1);
+	}
+	pool->zeroed_cnt = 0;
+}
+
+/* Moves free pages of POOL to its zeroed list, zeroing them with
+   interrupts on, until the list is full or POOL has no free page
+   left.  Returns true if it zeroed any page. */
+static bool
+zero_pages (struct pool *pool) {
+	bool zeroed = false;
+
+	for (;;) {
+		enum intr_level old_level = intr_disable ();
+		size_t page_idx = BITMAP_ERROR;
+		void *page;
+
+		if (pool->zeroed_cnt < PALLOC_ZERO_TARGET)
+			page_idx = buddy_alloc (pool, 0);
+		if (page_idx == BITMAP_ERROR) {
+			intr_set_level (old_level);
+			return zeroed;
+		}
+		bitmap_mark (pool->used_map, page_idx);
+		intr_set_level (old_level);
+
+		page = pool->base + PGSIZE * page_idx;
+		memset (page, 0, PGSIZE);
+		zeroed = true;
+
+		old_level = intr_disable ();
+		list_push_back (&pool->zeroed, &pool->pages[page_idx].free_elem);
+		pool->zeroed_cnt++;
+		intr_set_level (old_level);
+	}
+}
+
+/* Takes a page from the current thread's magazine for POOL,
+   refilling the magazine from POOL first if it is empty.  Returns
+   a null pointer if both are empty. */
+static void *
+magazine_get (struct pool *pool) {
+	struct palloc_magazine *mag =
+		&thread_current ()->page_mags[pool == &user_pool];
+	enum intr_level old_level = intr_disable ();
+	void *page = NULL;
+
+	if (mag->cnt == 0) {
+		pool->stats.pool_trips++;
+		while (mag->cnt < PALLOC_MAG_BATCH) {
+			size_t page_idx = pool_alloc (pool, 0);
+
+			if (page_idx == BITMAP_ERROR)
+				break;
+			ASSERT (!bitmap_test (pool->used_map, page_idx));
+			bitmap_mark (pool->used_map, page_idx);
+			mag->pages[mag->cnt++] = pool->base + PGSIZE * page_idx;
+		}
+	} else
+		pool->stats.magazine_hits++;
+
+	if (mag->cnt > 0)
+		page = mag->pages[--mag->cnt];
+	intr_set_level (old_level);
+	return page;
+}
+
+/* Puts PAGE, which belongs to POOL, in the current thread's
+   magazine for POOL, first draining the magazine if it is full. */
+static void
+magazine_put (struct pool *pool, void *page) {
+	struct palloc_magazine *mag =
+		&thread_current ()->page_mags[pool == &user_pool];
+	enum intr_level old_level = intr_disable ();
+
+#ifndef NDEBUG
+	size_t i;
+	ASSERT (bitmap_test (pool->used_map, pg_no (page) - pg_no (pool->base)));
+	for (i = 0; i < mag->cnt; i++)
+		ASSERT (mag->pages[i] != page);
+#endif
+	magazine_push (pool, mag, page);
+	intr_set_level (old_level);
+}
+
+/* Adds PAGE, which belongs to POOL, to MAG, first draining MAG if
+   it is full. */
+static void
+magazine_push (struct pool *pool, struct palloc_magazine *mag, void *page) {
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	if (mag->cnt == PALLOC_MAG_SIZE)
+		magazine_drain (pool, mag, PALLOC_MAG_BATCH);
+	mag->pages[mag->cnt++] = page;
+}
+
+/* Returns the PAGE_CNT least recently freed pages in MAG to POOL. */
+static void
+magazine_drain (struct pool *pool, struct palloc_magazine *mag,
+		size_t page_cnt) {
+	size_t i;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+	ASSERT (page_cnt <= mag->cnt);
+
+	if (page_cnt == 0)
+		return;
+
+	pool->stats.pool_trips++;
+	for (i = 0; i < page_cnt; i++) {
+		size_t page_idx = pg_no (mag->pages[i]) - pg_no (pool->base);
+
+		bitmap_reset (pool->used_map, page_idx);
+		buddy_free (pool, page_idx, 1);
+	}
+	mag->cnt -= page_cnt;
+	memmove (mag->pages, mag->pages + page_cnt, mag->cnt * sizeof *mag->pages);
+}
+
+/* Returns all the pages in thread T's magazine for AUX, a pool,
+   to the pool. */
+static void
+magazine_drain_thread (struct thread *t, void *aux) {
+	struct pool *pool = aux;
+	struct palloc_magazine *mag = &t->page_mags[pool == &user_pool];
+
+	magazine_drain (pool, mag, mag->cnt);
+}
+
+/* Returns all the pages in every thread's magazine for POOL to
+   POOL. */
+static void
+magazine_drain_all (struct pool *pool) {
+	enum intr_level old_level = intr_disable ();
+
+	thread_foreach (magazine_drain_thread, pool);
+	intr_set_level (old_level);
+}
+
+/* Removes a free block of 2**ORDER pages from POOL, splitting a
+   larger one if necessary, and returns the index of its first
+   page.  Returns BITMAP_ERROR if there is no block that large. */
+static size_t
+buddy_alloc (struct pool *pool, int order) {
+	struct page_info *info;
+	size_t page_idx;
+	int o;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	for (o = order; o < PALLOC_ORDERS; o++)
+		if (!list_empty (&pool->free_lists[o]))
+			break;
+	if (o == PALLOC_ORDERS)
+		return BITMAP_ERROR;
+
+	info = list_entry (list_pop_front (&pool->free_lists[o]),
+			struct page_info, free_elem);
+	info->order = -1;
+	page_idx = info - pool->pages;
+
+	/* Keep the lower half, free the upper half. */
+	while (o > order) {
+		o--;
+		info = &pool->pages[page_idx + ((size_t) 1 << o)];
+		info->order = o;
+		list_push_front (&pool->free_lists[o], &info->free_elem);
+	}
+	return page_idx;
+}
+
+/* Returns the PAGE_CNT pages starting at PAGE_IDX to POOL's free
+   lists, as the largest aligned blocks that tile them. */
+static void
+buddy_free (struct pool *pool, size_t page_idx, size_t page_cnt) {
+	ASSERT (intr_get_level () == INTR_OFF);
+	ASSERT (page_idx + page_cnt <= pool->page_cnt);
+
+	while (page_cnt > 0) {
+		int order = 0;
+
+		while (order + 1 < PALLOC_ORDERS
+				&& page_idx % ((size_t) 2 << order) == 0
+				&& ((size_t) 2 << order) <= page_cnt)
+			order++;
+		buddy_free_block (pool, page_idx, order);
+		page_idx += (size_t) 1 << order;
+		page_cnt -= (size_t) 1 << order;
+	}
+}
+
+/* Returns the block of 2**ORDER pages starting at PAGE_IDX to
+   POOL, merging it with its buddy as long as that is free. */
+static void
+buddy_free_block (struct pool *pool, size_t page_idx, int order) {
+	struct page_info *info;
+
+	while (order + 1 < PALLOC_ORDERS) {
+		size_t buddy_idx = page_idx ^ ((size_t) 1 << order);
+		struct page_info *buddy = &pool->pages[buddy_idx];
+
+		if (buddy_idx + ((size_t) 1 << order) > pool->page_cnt
+				|| buddy->order != order)
+			break;
+		list_remove (&buddy->free_elem);
+		buddy->order = -1;
+		page_idx &= ~((size_t) 1 << order);
+		order++;
+	}
+
+	info = &pool->pages[page_idx];
+	info->order = order;
+	list_push_front (&pool->free_lists[order], &info->free_elem);
+}
@@ -0,0 +1,122 @@
+#include "threads/profile.h"
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "threads/interrupt.h"
+#include "threads/loader.h"
+#include "threads/palloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* Sampling profiler.
+
+   On every timer tick, timer_interrupt() hands us the interrupted
+   context.  We record the instruction pointer and, if requested,
+   the return addresses of up to profile_depth callers found by
+   walking the chain of saved frame pointers.  Samples go into a
+   ring buffer allocated at boot, so once it fills up the oldest
+   samples are overwritten.
+
+   At power off the samples are printed one per line, innermost
+   frame first:
+
+	Profile sample: 0x8004207a1c 0x8004209d0e ...
+
+   and "backtrace -p" or "backtrace -f" turns the output into a
+   flat profile or into folded stacks for flamegraph.pl. */
+
+/* Size of the sample buffer, in pages. */
+#define PROFILE_PAGES 64
+
+/* Flag in a sample's header word: the sample was taken in user
+   mode and holds a single user address. */
+#define SAMPLE_USER ((uint64_t) 1 << 63)
+
+bool profile_enabled;
+unsigned profile_depth;
+
+/* Sample buffer.  Each sample occupies `stride' words: a header
+   word holding the number of addresses and the SAMPLE_USER flag,
+   followed by the addresses themselves. */
+static uint64_t *samples;
+static size_t stride;           /* Words per sample. */
+static size_t sample_slots;     /* Number of samples that fit. */
+static size_t sample_cnt;       /* Samples taken, including overwritten. */
+
+/* Allocates the sample buffer, if profiling was requested on the
+   kernel command line.  Must be called after palloc_init(). */
+void
+profile_init (void) {
+	if (!profile_enabled)
+		return;
+
+	if (profile_depth > PROFILE_MAX_DEPTH)
+		profile_depth = PROFILE_MAX_DEPTH;
+	stride = profile_depth + 2;
+	samples = palloc_get_multiple (PAL_ASSERT, PROFILE_PAGES);
+	sample_slots = PROFILE_PAGES * PGSIZE / (stride * sizeof *samples);
+	sample_cnt = 0;
+}
+
+/* Records the context interrupted by the timer, F.  Called from
+   the timer interrupt handler. */
+void
+profile_sample (const struct intr_frame *f) {
+	uint64_t *s;
+	uintptr_t stack, fp;
+	size_t n;
+
+	if (samples == NULL)
+		return;
+
+	s = samples + (sample_cnt++ % sample_slots) * stride;
+	s[1] = f->rip;
+	if (f->cs == SEL_UCSEG) {
+		s[0] = SAMPLE_USER | 1;
+		return;
+	}
+
+	/* Follow the saved frame pointers, but only as long as they
+	   stay within the interrupted thread's stack page and keep
+	   moving toward its top. */
+	stack = (uintptr_t) thread_current ();
+	fp = f->R.rbp;
+	n = 1;
+	while (n <= profile_depth) {
+		uint64_t *frame = (uint64_t *) fp;
+
+		if (fp <= stack || fp > stack + PGSIZE - 2 * sizeof *frame
+				|| frame[1] == 0)
+			break;
+		s[++n] = frame[1];
+		if (frame[0] <= fp)
+			break;
+		fp = frame[0];
+	}
+	s[0] = n;
+}
+
+/* Stops sampling and prints the samples in the buffer. */
+void
+profile_dump (void) {
+	size_t first, i;
+
+	if (samples == NULL)
+		return;
+
+	intr_disable ();
+	first = sample_cnt > sample_slots ? sample_cnt - sample_slots : 0;
+	printf ("Profile: %zu samples, %zu overwritten, depth %u.\n",
+			sample_cnt, first, profile_depth);
+	for (i = first; i < sample_cnt; i++) {
+		uint64_t *s = samples + (i % sample_slots) * stride;
+		size_t n = s[0] & ~SAMPLE_USER;
+		size_t j;
+
+		printf ("Profile sample:%s", s[0] & SAMPLE_USER ? " user" : "");
+		for (j = 1; j <= n; j++)
+			printf (" %#"PRIx64, s[j]);
+		printf ("\n");
+	}
+	samples = NULL;
+}
@@ -27,10 +27,120 @@
    */
 
 #include "threads/synch.h"
+#include <inttypes.h>
 #include <stdio.h>
 #include <string.h>
 #include "threads/interrupt.h"
 #include "threads/thread.h"
+#ifdef LOCK_STATS
+#include "devices/timer.h"
+#include "intrinsic.h"
+#endif
+
+static bool waitq_less (const struct pheap_elem *, const struct pheap_elem *,
+		void *aux);
+static void donate_priority (struct lock *);
+#ifdef LOCK_STATS
+static void lock_stats_acquired (struct lock *, bool contended,
+		int64_t wait_start);
+static void lock_stats_released (struct lock *);
+#endif
+
+/* Initializes Q as an empty wait queue. */
+void
+waitq_init (struct waitq *q) {
+	ASSERT (q != NULL);
+
+	pheap_init (&q->heap, waitq_less, NULL);
+	q->next_seq = 0;
+}
+
+/* Returns true if no thread is waiting in Q. */
+bool
+waitq_empty (const struct waitq *q) {
+	return pheap_empty (&q->heap);
+}
+
+/* Queues thread T in Q through element E.  E must not already be
+   in a queue.  Interrupts must be off, since the waiters' order
+   may change from an interrupt handler. */
+void
+waitq_push (struct waitq *q, struct waitq_elem *e, struct thread *t) {
+	ASSERT (intr_get_level () == INTR_OFF);
+	ASSERT (t != NULL);
+
+	e->thread = t;
+	e->queue = q;
+	e->seq = q->next_seq++;
+	pheap_insert (&q->heap, &e->heap_elem);
+	list_push_back (&t->waitqs, &e->thread_elem);
+}
+
+/* Removes and returns the highest-priority, longest-waiting
+   element of Q, which must not be empty. */
+struct waitq_elem *
+waitq_pop (struct waitq *q) {
+	struct waitq_elem *e;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	e = pheap_entry (pheap_pop_max (&q->heap), struct waitq_elem, heap_elem);
+	list_remove (&e->thread_elem);
+	e->queue = NULL;
+	return e;
+}
+
+/* Removes E from the queue it is in. */
+void
+waitq_remove (struct waitq_elem *e) {
+	ASSERT (intr_get_level () == INTR_OFF);
+	ASSERT (e->queue != NULL);
+
+	pheap_remove (&e->queue->heap, &e->heap_elem);
+	list_remove (&e->thread_elem);
+	e->queue = NULL;
+}
+
+/* Returns the priority of the highest-priority thread in Q, or
+   PRI_MIN - 1 if Q is empty. */
+int
+waitq_max_priority (const struct waitq *q) {
+	struct pheap_elem *top = pheap_max (&q->heap);
+
+	if (top == NULL)
+		return PRI_MIN - 1;
+	return pheap_entry (top, struct waitq_elem, heap_elem)->thread->priority;
+}
+
+/* Moves T to its new place in every wait queue it is in, after
+   its priority has changed.  A thread is in at most two queues
+   at once: a condition variable's and its private semaphore's. */
+void
+waitq_rekey (struct thread *t) {
+	struct list_elem *e;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	for (e = list_begin (&t->waitqs); e != list_end (&t->waitqs);
+			e = list_next (e)) {
+		struct waitq_elem *w = list_entry (e, struct waitq_elem, thread_elem);
+		pheap_update (&w->queue->heap, &w->heap_elem);
+	}
+}
+
+/* Orders wait queue elements by their thread's priority, then by
+   arrival, earlier arrivals counting as greater so that they are
+   woken first. */
+static bool
+waitq_less (const struct pheap_elem *a_, const struct pheap_elem *b_,
+		void *aux UNUSED) {
+	const struct waitq_elem *a = pheap_entry (a_, struct waitq_elem, heap_elem);
+	const struct waitq_elem *b = pheap_entry (b_, struct waitq_elem, heap_elem);
+
+	if (a->thread->priority != b->thread->priority)
+		return a->thread->priority < b->thread->priority;
+	return (int) (a->seq - b->seq) > 0;
+}
 
 /* Initializes semaphore SEMA to VALUE.  A semaphore is a
    nonnegative integer along with two atomic operators for
@@ -46,7 +156,7 @@ sema_init (struct semaphore *sema, unsigned value) {
 	ASSERT (sema != NULL);
 
 	sema->value = value;
-	list_init (&sema->waiters);
+	waitq_init (&sema->waiters);
 }
 
 /* Down or "P" operation on a semaphore.  Waits for SEMA's value
@@ -59,6 +169,7 @@ sema_init (struct semaphore *sema, unsigned value) {
    sema_down function. */
 void
 sema_down (struct semaphore *sema) {
+	struct thread *curr = thread_current ();
 	enum intr_level old_level;
 
 	ASSERT (sema != NULL);
@@ -66,8 +177,7 @@ sema_down (struct semaphore *sema) {
 
 	old_level = intr_disable ();
 	while (sema->value == 0) {
-		//list_push_back (&sema->waiters, &thread_current ()->elem);
-		list_insert_ordered(&sema->waiters, &thread_current()->elem, thread_compare_priority, 0);
+		waitq_push (&sema->waiters, &curr->wait_elem, curr);
 		thread_block ();
 	}
 	sema->value--;
@@ -110,12 +220,8 @@ sema_up (struct semaphore *sema) {
 	ASSERT (sema != NULL);
 
 	old_level = intr_disable ();
-	if (!list_empty (&sema->waiters)){
-		list_sort(&sema->waiters, thread_compare_priority, 0);
-		
-		struct thread *t = list_entry(list_pop_front(&sema->waiters), struct thread, elem);
-		thread_unblock(t);
-	}
+	if (!waitq_empty (&sema->waiters))
+		thread_unblock (waitq_pop (&sema->waiters)->thread);
 
 	sema->value++;
 	thread_test_preemption();
@@ -178,24 +284,63 @@ lock_init (struct lock *lock) {
 
 	lock->holder = NULL;
 	sema_init (&lock->semaphore, 1);
+#ifdef LOCK_STATS
+	lock->stats = NULL;
+#endif
 }
 
 /* Acquires LOCK, sleeping until it becomes available if
    necessary.  The lock must not already be held by the current
    thread.
 
+   While waiting, the current thread donates its priority to the
+   holder of LOCK, and transitively to the holder of any lock that
+   thread is waiting for in turn.
+
    This function may sleep, so it must not be called within an
    interrupt handler.  This function may be called with
    interrupts disabled, but interrupts will be turned back on if
    we need to sleep. */
 void
 lock_acquire (struct lock *lock) {
+	struct thread *curr = thread_current ();
+	enum intr_level old_level;
+#ifdef LOCK_STATS
+	bool contended;
+	int64_t wait_start;
+#endif
+
 	ASSERT (lock != NULL);
 	ASSERT (!intr_context ());
 	ASSERT (!lock_held_by_current_thread (lock));
 
-	sema_down (&lock->semaphore);
-	lock->holder = thread_current ();
+	old_level = intr_disable ();
+#ifdef LOCK_STATS
+	contended = lock->semaphore.value == 0;
+	wait_start = contended ? timer_ticks () : 0;
+#endif
+	/* sema_down(), except that the waiters double as the donors,
+	   so we must be queued before donating. */
+	while (lock->semaphore.value == 0) {
+		waitq_push (&lock->semaphore.waiters, &curr->wait_elem, curr);
+		if (!thread_mlfqs) {
+			curr->wait_on_lock = lock;
+			donate_priority (lock);
+		}
+		thread_block ();
+	}
+	lock->semaphore.value--;
+	curr->wait_on_lock = NULL;
+	lock->holder = curr;
+	if (!thread_mlfqs) {
+		/* Threads still waiting for LOCK now donate to us. */
+		pheap_insert (&curr->held_locks, &lock->held_elem);
+		thread_refresh_priority (curr);
+	}
+#ifdef LOCK_STATS
+	lock_stats_acquired (lock, contended, wait_start);
+#endif
+	intr_set_level (old_level);
 }
 
 /* Tries to acquires LOCK and returns true if successful or false
@@ -206,14 +351,25 @@ lock_acquire (struct lock *lock) {
    interrupt handler. */
 bool
 lock_try_acquire (struct lock *lock) {
+	enum intr_level old_level;
 	bool success;
 
 	ASSERT (lock != NULL);
 	ASSERT (!lock_held_by_current_thread (lock));
 
+	old_level = intr_disable ();
 	success = sema_try_down (&lock->semaphore);
-	if (success)
+	if (success) {
 		lock->holder = thread_current ();
+		if (!thread_mlfqs) {
+			pheap_insert (&lock->holder->held_locks, &lock->held_elem);
+			thread_refresh_priority (lock->holder);
+		}
+#ifdef LOCK_STATS
+		lock_stats_acquired (lock, false, 0);
+#endif
+	}
+	intr_set_level (old_level);
 	return success;
 }
 
@@ -222,14 +378,28 @@ lock_try_acquire (struct lock *lock) {
 
    An interrupt handler cannot acquire a lock, so it does not
    make sense to try to release a lock within an interrupt
-   handler. */
+   handler.
+
+   Gives up any priority donated through LOCK, which takes O(log n)
+   time in the number of locks held. */
 void
 lock_release (struct lock *lock) {
+	enum intr_level old_level;
+
 	ASSERT (lock != NULL);
 	ASSERT (lock_held_by_current_thread (lock));
 
+	old_level = intr_disable ();
+#ifdef LOCK_STATS
+	lock_stats_released (lock);
+#endif
+	if (!thread_mlfqs) {
+		pheap_remove (&lock->holder->held_locks, &lock->held_elem);
+		thread_refresh_priority (lock->holder);
+	}
 	lock->holder = NULL;
 	sema_up (&lock->semaphore);
+	intr_set_level (old_level);
 }
 
 /* Returns true if the current thread holds LOCK, false
@@ -242,9 +412,300 @@ lock_held_by_current_thread (const struct lock *lock) {
 	return lock->holder == thread_current ();
 }
 
-/* One semaphore in a list. */
+#ifdef LOCK_STATS
+/* Registered lock statistics. */
+#define LOCK_STATS_MAX 64
+static struct lock_stats lock_stats[LOCK_STATS_MAX];
+static size_t lock_stats_cnt;
+
+/* Initializes LOCK like lock_init() and, when the kernel is built
+   with LOCK_STATS, gathers contention statistics for it under
+   NAME.  Locks initialized with the same NAME share statistics.
+   Without LOCK_STATS, NAME is ignored. */
+void
+lock_init_named (struct lock *lock, const char *name) {
+	enum intr_level old_level;
+	size_t i;
+
+	ASSERT (name != NULL);
+
+	lock_init (lock);
+
+	old_level = intr_disable ();
+	for (i = 0; i < lock_stats_cnt; i++)
+		if (!strcmp (lock_stats[i].name, name))
+			break;
+	if (i == lock_stats_cnt && lock_stats_cnt < LOCK_STATS_MAX)
+		strlcpy (lock_stats[lock_stats_cnt++].name, name,
+				sizeof lock_stats[i].name);
+	if (i < lock_stats_cnt)
+		lock->stats = &lock_stats[i];
+	intr_set_level (old_level);
+}
+
+/* Accounts for LOCK having just been acquired, after waiting
+   since tick WAIT_START if CONTENDED. */
+static void
+lock_stats_acquired (struct lock *lock, bool contended, int64_t wait_start) {
+	struct lock_stats *s = lock->stats;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	lock->acquired_at = rdtsc ();
+	if (s == NULL)
+		return;
+
+	s->acquisitions++;
+	if (contended) {
+		int64_t wait = timer_elapsed (wait_start);
+
+		s->contended++;
+		s->wait_ticks += wait;
+		if (wait > s->max_wait_ticks)
+			s->max_wait_ticks = wait;
+	}
+}
+
+/* Accounts for LOCK being about to be released. */
+static void
+lock_stats_released (struct lock *lock) {
+	struct lock_stats *s = lock->stats;
+	uint64_t held;
+	size_t bucket;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	if (s == NULL)
+		return;
+
+	held = rdtsc () - lock->acquired_at;
+	for (bucket = 0; bucket < LOCK_HOLD_BUCKETS - 1; bucket++)
+		if (held < (uint64_t) 4 << (2 * bucket))
+			break;
+	s->hold_hist[bucket]++;
+}
+
+/* Prints the statistics of every named lock that was acquired at
+   least once. */
+void
+lock_print_stats (void) {
+	size_t i, b;
+
+	printf ("Locks: %-16s %10s %10s %10s %8s\n",
+			"name", "acquired", "contended", "wait", "max wait");
+	for (i = 0; i < lock_stats_cnt; i++) {
+		const struct lock_stats *s = &lock_stats[i];
+
+		if (s->acquisitions == 0)
+			continue;
+		printf ("Locks: %-16s %10"PRIu64" %10"PRIu64" %10"PRId64" %8"PRId64"\n",
+				s->name, s->acquisitions, s->contended,
+				s->wait_ticks, s->max_wait_ticks);
+		printf ("  hold cycles:");
+		for (b = 0; b < LOCK_HOLD_BUCKETS; b++)
+			if (s->hold_hist[b] != 0)
+				printf (" %s4^%zu:%"PRIu64, b < LOCK_HOLD_BUCKETS - 1 ? "<" : ">=",
+						b < LOCK_HOLD_BUCKETS - 1 ? b + 1 : b, s->hold_hist[b]);
+		printf ("\n");
+	}
+}
+#else /* !LOCK_STATS */
+/* Initializes LOCK like lock_init().  NAME is used only when the
+   kernel is built with LOCK_STATS. */
+void
+lock_init_named (struct lock *lock, const char *name UNUSED) {
+	lock_init (lock);
+}
+#endif /* LOCK_STATS */
+
+/* Returns the highest priority of the threads waiting for LOCK,
+   or PRI_MIN - 1 if there are none. */
+int
+lock_donated_priority (const struct lock *lock) {
+	return waitq_max_priority (&lock->semaphore.waiters);
+}
+
+/* Orders the locks in a thread's `held_locks' by the priority
+   donated through them. */
+bool
+lock_donation_less (const struct pheap_elem *a_, const struct pheap_elem *b_,
+		void *aux UNUSED) {
+	const struct lock *a = pheap_entry (a_, struct lock, held_elem);
+	const struct lock *b = pheap_entry (b_, struct lock, held_elem);
+
+	return lock_donated_priority (a) < lock_donated_priority (b);
+}
+
+/* Passes the priority of LOCK's highest-priority waiter on to its
+   holder, then along the chain of locks that holder and its
+   successors are waiting for.  Stops as soon as a holder's
+   effective priority does not change, since nothing further up
+   the chain can change either.  Raising a holder's priority also
+   moves it up in the waiters of the lock it waits for, through
+   waitq_rekey(). */
+static void
+donate_priority (struct lock *lock) {
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	while (lock != NULL && lock->holder != NULL) {
+		struct thread *holder = lock->holder;
+
+		/* LOCK's donated priority may have gone up. */
+		pheap_update (&holder->held_locks, &lock->held_elem);
+		if (!thread_refresh_priority (holder))
+			break;
+
+		lock = holder->wait_on_lock;
+	}
+}
+
+/* Initializes RW as an unheld readers-writer lock. */
+void
+rwlock_init (struct rwlock *rw) {
+	ASSERT (rw != NULL);
+
+	lock_init (&rw->lock);
+	rw->readers = 0;
+	rw->draining = false;
+	sema_init (&rw->drained, 0);
+}
+
+/* Acquires RW for reading, sleeping while a writer holds it or is
+   waiting for it.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+void
+rwlock_acquire_read (struct rwlock *rw) {
+	enum intr_level old_level;
+
+	ASSERT (rw != NULL);
+	ASSERT (!intr_context ());
+	ASSERT (!lock_held_by_current_thread (&rw->lock));
+
+	old_level = intr_disable ();
+	if (rw->lock.holder != NULL || !waitq_empty (&rw->lock.semaphore.waiters)) {
+		/* Queue behind the writers, donating to the one in front. */
+		lock_acquire (&rw->lock);
+		rw->readers++;
+		lock_release (&rw->lock);
+	} else
+		rw->readers++;
+	intr_set_level (old_level);
+}
+
+/* Releases RW, which the current thread must hold for reading. */
+void
+rwlock_release_read (struct rwlock *rw) {
+	enum intr_level old_level;
+
+	ASSERT (rw != NULL);
+
+	old_level = intr_disable ();
+	ASSERT (rw->readers > 0);
+	if (--rw->readers == 0 && rw->draining) {
+		rw->draining = false;
+		sema_up (&rw->drained);
+	}
+	intr_set_level (old_level);
+}
+
+/* Acquires RW for writing, sleeping until no other thread holds it
+   in either mode.  Readers already inside are allowed to finish,
+   but no new ones get in once we start waiting.
+
+   A writer waiting for readers to leave does not donate its
+   priority to them, since the readers are not tracked.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+void
+rwlock_acquire_write (struct rwlock *rw) {
+	enum intr_level old_level;
+
+	ASSERT (rw != NULL);
+	ASSERT (!intr_context ());
+
+	lock_acquire (&rw->lock);
+
+	old_level = intr_disable ();
+	while (rw->readers > 0) {
+		rw->draining = true;
+		sema_down (&rw->drained);
+	}
+	intr_set_level (old_level);
+}
+
+/* Releases RW, which the current thread must hold for writing. */
+void
+rwlock_release_write (struct rwlock *rw) {
+	ASSERT (rw != NULL);
+
+	lock_release (&rw->lock);
+}
+
+/* Returns true if the current thread holds RW for writing. */
+bool
+rwlock_held_for_write (const struct rwlock *rw) {
+	ASSERT (rw != NULL);
+
+	return lock_held_by_current_thread (&rw->lock);
+}
+
+/* Initializes sequence lock SL. */
+void
+seqlock_init (struct seqlock *sl) {
+	ASSERT (sl != NULL);
+
+	sl->seq = 0;
+}
+
+/* Starts a read of the data protected by SL and returns the
+   sequence number to pass to seqlock_read_retry(). */
+unsigned
+seqlock_read_begin (const struct seqlock *sl) {
+	unsigned seq = *(volatile const unsigned *) &sl->seq;
+
+	/* Writers run with interrupts off, so on a single CPU we can
+	   only catch one in the act by reading from inside it. */
+	ASSERT ((seq & 1) == 0);
+	barrier ();
+	return seq;
+}
+
+/* Returns true if the data protected by SL changed since the
+   seqlock_read_begin() call that returned SEQ, in which case the
+   read must be redone. */
+bool
+seqlock_read_retry (const struct seqlock *sl, unsigned seq) {
+	barrier ();
+	return *(volatile const unsigned *) &sl->seq != seq;
+}
+
+/* Starts an update of the data protected by SL.  Interrupts must
+   be off until the matching seqlock_write_end(). */
+void
+seqlock_write_begin (struct seqlock *sl) {
+	ASSERT (intr_get_level () == INTR_OFF);
+	ASSERT ((sl->seq & 1) == 0);
+
+	sl->seq++;
+	barrier ();
+}
+
+/* Finishes an update of the data protected by SL. */
+void
+seqlock_write_end (struct seqlock *sl) {
+	ASSERT (intr_get_level () == INTR_OFF);
+	ASSERT ((sl->seq & 1) == 1);
+
+	barrier ();
+	sl->seq++;
+}
+
+/* One semaphore in a condition variable's waiters. */
 struct semaphore_elem {
-	struct list_elem elem;              /* List element. */
+	struct waitq_elem elem;             /* Wait queue element. */
 	struct semaphore semaphore;         /* This semaphore. */
 };
 
@@ -255,7 +716,7 @@ void
 cond_init (struct condition *cond) {
 	ASSERT (cond != NULL);
 
-	list_init (&cond->waiters);
+	waitq_init (&cond->waiters);
 }
 
 /* Atomically releases LOCK and waits for COND to be signaled by
@@ -281,6 +742,7 @@ cond_init (struct condition *cond) {
 void
 cond_wait (struct condition *cond, struct lock *lock) {
 	struct semaphore_elem waiter;
+	enum intr_level old_level;
 
 	ASSERT (cond != NULL);
 	ASSERT (lock != NULL);
@@ -288,7 +750,9 @@ cond_wait (struct condition *cond, struct lock *lock) {
 	ASSERT (lock_held_by_current_thread (lock));
 
 	sema_init (&waiter.semaphore, 0);
-	list_push_back (&cond->waiters, &waiter.elem);
+	old_level = intr_disable ();
+	waitq_push (&cond->waiters, &waiter.elem, thread_current ());
+	intr_set_level (old_level);
 	lock_release (lock);
 	sema_down (&waiter.semaphore);
 	lock_acquire (lock);
@@ -303,14 +767,21 @@ cond_wait (struct condition *cond, struct lock *lock) {
    interrupt handler. */
 void
 cond_signal (struct condition *cond, struct lock *lock UNUSED) {
+	struct waitq_elem *e = NULL;
+	enum intr_level old_level;
+
 	ASSERT (cond != NULL);
 	ASSERT (lock != NULL);
 	ASSERT (!intr_context ());
 	ASSERT (lock_held_by_current_thread (lock));
 
-	if (!list_empty (&cond->waiters))
-		sema_up (&list_entry (list_pop_front (&cond->waiters),
-					struct semaphore_elem, elem)->semaphore);
+	old_level = intr_disable ();
+	if (!waitq_empty (&cond->waiters))
+		e = waitq_pop (&cond->waiters);
+	intr_set_level (old_level);
+
+	if (e != NULL)
+		sema_up (&waitq_entry (e, struct semaphore_elem, elem)->semaphore);
 }
 
 /* Wakes up all threads, if any, waiting on COND (protected by
@@ -324,6 +795,6 @@ cond_broadcast (struct condition *cond, struct lock *lock) {
 	ASSERT (cond != NULL);
 	ASSERT (lock != NULL);
 
-	while (!list_empty (&cond->waiters))
+	while (!waitq_empty (&cond->waiters))
 		cond_signal (cond, lock);
 }
@@ -11,6 +11,7 @@
 #include "threads/palloc.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
+#include "devices/timer.h"
 #include "intrinsic.h"
 #ifdef USERPROG
 #include "userprog/process.h"
@@ -25,17 +26,55 @@
    Do not modify this value. */
 #define THREAD_BASIC 0xd42df210
 
-/* List of processes in THREAD_READY state, that is, processes
-   that are ready to run but not actually running. */
-static struct list ready_list;
+/* Processes in THREAD_READY state, that is, processes that are
+   ready to run but not actually running.  There is one FIFO queue
+   per priority level, and bit P of ready_mask is set iff
+   ready_queues[P] is non-empty, so the highest runnable priority
+   is a single bit scan away. */
+static struct list ready_queues[PRI_MAX + 1];
+static uint64_t ready_mask;
+static size_t ready_cnt;        /* # of threads in all ready_queues. */
+#if PRI_MIN < 0 || PRI_MAX >= 64
+#error ready_mask needs one bit per priority level
+#endif
 
-/* blocked thread 넣을 곳 */
-static struct list sleep_list;
+/* Sleeping threads, hashed by wakeup_tick into a timing wheel.
+   Slot S holds, in no particular order, every sleeper whose
+   wakeup_tick % SLEEP_WHEEL_SIZE == S, and bit S of
+   sleep_wheel_mask is set iff slot S is non-empty.  Every sleeper
+   has a wakeup_tick greater than wheel_tick, the last tick swept by
+   thread_awake(), and next_wakeup is a lower bound on the earliest
+   of them, so the timer interrupt can skip thread_awake() entirely
+   until next_wakeup arrives. */
+#define SLEEP_WHEEL_SIZE 256
+static struct list sleep_wheel[SLEEP_WHEEL_SIZE];
+static uint64_t sleep_wheel_mask[SLEEP_WHEEL_SIZE / 64];
+static int64_t wheel_tick;
+static int64_t next_wakeup;
 
 /* List of all processes. Processes are added to this list
 when they are first scheduled and removed when they exit. */
 static struct list all_list;	// mlfqs에서 사용
 
+/* System load average, in 17.14 fixed point. */
+static int load_avg;
+
+/* MLFQS recent_cpu decay.  Rather than decaying every thread's
+   recent_cpu once per second, mlfqs_recalc() starts a new epoch
+   and records its decay coefficient, and mlfqs_recent_cpu()
+   applies the decays a thread has missed when it is next looked
+   at.  Coefficients are kept for the last MLFQS_DECAY_HISTORY
+   epochs. */
+#define MLFQS_DECAY_HISTORY 64
+static int decay_coef[MLFQS_DECAY_HISTORY];
+static unsigned decay_epoch;
+
+/* Position of mlfqs_sweep() in all_list, or NULL if no sweep is in
+   progress, and the epoch that the sweep started in. */
+#define MLFQS_SWEEP_BATCH 16
+static struct list_elem *sweep_cursor;
+static unsigned sweep_epoch;
+
 /* Idle thread. */
 static struct thread *idle_thread;
 
@@ -67,9 +106,15 @@ static void kernel_thread (thread_func *, void *aux);
 static void idle (void *aux UNUSED);
 static struct thread *next_thread_to_run (void);
 static void init_thread (struct thread *, const char *name, int priority);
+static void ready_queue_push (struct thread *);
+static void ready_queue_remove (struct thread *);
+static int ready_queue_max_priority (void);
+static int sleep_wheel_scan (int slot);
+static void sleep_wheel_expire (int slot, int64_t now);
 static void do_schedule(int status);
 static void schedule (void);
 static tid_t allocate_tid (void);
+static int fp_pow (int x, unsigned n);
 
 /* Returns true if T appears to point to a valid thread. */
 #define is_thread(t) ((t) != NULL && (t)->magic == THREAD_MAGIC)
@@ -114,9 +159,16 @@ thread_init (void) {
 	lgdt (&gdt_ds);
 
 	/* Init the global thread context */
-	lock_init (&tid_lock);
-	list_init (&ready_list);
-	list_init (&sleep_list);	// 만든 리스트 초기화
+	lock_init_named (&tid_lock, "tid");
+	for (int pri = PRI_MIN; pri <= PRI_MAX; pri++)
+		list_init (&ready_queues[pri]);
+	ready_mask = 0;
+	ready_cnt = 0;
+	for (int slot = 0; slot < SLEEP_WHEEL_SIZE; slot++)
+		list_init (&sleep_wheel[slot]);	// 만든 리스트 초기화
+	memset (sleep_wheel_mask, 0, sizeof sleep_wheel_mask);
+	wheel_tick = 0;
+	next_wakeup = INT64_MAX;
 	list_init (&all_list);	// 만든 리스트 초기화 (mlfqs에서 사용)
 	list_init (&destruction_req);
 	
@@ -165,6 +217,13 @@ thread_tick (void) {
 		intr_yield_on_return ();
 }
 
+/* Accounts for CNT timer ticks that the idle thread slept through
+   with the periodic timer stopped.  See timer_idle_enter(). */
+void
+thread_tick_idle (int64_t cnt) {
+	idle_ticks += cnt;
+}
+
 /* Prints thread statistics. */
 void
 thread_print_stats (void) {
@@ -253,8 +312,9 @@ thread_unblock (struct thread *t) {
 
 	old_level = intr_disable ();
 	ASSERT (t->status == THREAD_BLOCKED);
-	// list_push_back (&ready_list, &t->elem);
-	list_insert_ordered(&ready_list, &t->elem, thread_compare_priority, 0);
+	if (thread_mlfqs)
+		mlfqs_priority (t);	// 자는 동안 밀린 decay 반영
+	ready_queue_push (t);
 	t->status = THREAD_READY;
 	intr_set_level (old_level);
 }
@@ -269,8 +329,16 @@ void thread_sleep(int64_t ticks){	// 매개변수 -> 시간 => int
 	old_level = intr_disable ();	// 인터럽트 OFF + 이전 상태(INTR_ON) 반환
 
 	if (curr != idle_thread){	// 현재 쓰레드가 idle thread가 아니라면
+		/* 이미 지나간 tick이면 다음 tick에 깨운다. */
+		if (ticks <= wheel_tick)
+			ticks = wheel_tick + 1;
 		curr->wakeup_tick = ticks;	// 깨울 시간 저장 (ticks)
-		list_push_back (&sleep_list, &curr->elem);	// sleep_list에 추가
+
+		int slot = ticks % SLEEP_WHEEL_SIZE;
+		list_push_back (&sleep_wheel[slot], &curr->elem);	// sleep wheel에 추가
+		sleep_wheel_mask[slot / 64] |= 1ULL << (slot % 64);
+		if (ticks < next_wakeup)
+			next_wakeup = ticks;
 	}
 	
 	thread_block();	// block status로 변경 (재우기 완료)
@@ -278,30 +346,92 @@ void thread_sleep(int64_t ticks){	// 매개변수 -> 시간 => int
 	// return level == INTR_ON ? intr_enable () : intr_disable ();
 }
 
+/* Wakes every sleeping thread whose wakeup_tick is at most TICKS.
+   Only the wheel slots for the ticks since the previous call are
+   visited, skipping empty ones. */
 void thread_awake(int64_t ticks){	// 매개변수 -> 시간 => int
-	struct thread *t;
-	struct list_elem *now = list_begin(&sleep_list);	// sleep_list가 아닌 &sleep_list를 넣어야 함수가 리스트 수정하거나 직접 액세스 할 수 있음
+	int64_t span = ticks - wheel_tick;	// 지난 호출 이후 흐른 tick 수
+	int64_t base = wheel_tick + 1;
+	int64_t off = 0;
+	int d;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	if (span <= 0)
+		return;
+	if (span > SLEEP_WHEEL_SIZE)	// 한 바퀴 이상 지났으면 모든 slot 확인
+		span = SLEEP_WHEEL_SIZE;
+
+	while (off < span) {
+		d = sleep_wheel_scan ((base + off) % SLEEP_WHEEL_SIZE);
+		if (d < 0 || off + d >= span)
+			break;
+		off += d;
+		sleep_wheel_expire ((base + off) % SLEEP_WHEEL_SIZE, ticks);
+		off++;
+	}
+	wheel_tick = ticks;
+
+	/* 다음으로 비어있지 않은 slot이 다음 깨울 시간의 하한 */
+	d = sleep_wheel_scan ((ticks + 1) % SLEEP_WHEEL_SIZE);
+	next_wakeup = d < 0 ? INT64_MAX : ticks + 1 + d;
+}
+
+/* Returns a lower bound on the earliest tick at which a sleeping
+   thread is due, or INT64_MAX if no thread is sleeping. */
+int64_t
+thread_next_wakeup (void) {
+	return next_wakeup;
+}
+
+/* Returns the distance from SLOT to the first non-empty slot of the
+   sleep wheel at or after it, wrapping around, or -1 if the wheel
+   is empty. */
+static int
+sleep_wheel_scan (int slot) {
+	int d = 0;
+
+	while (d < SLEEP_WHEEL_SIZE) {
+		int s = (slot + d) % SLEEP_WHEEL_SIZE;
+		uint64_t word = sleep_wheel_mask[s / 64] >> (s % 64);
+		if (word != 0)
+			return d + __builtin_ctzll (word);
+		d += 64 - s % 64;
+	}
+	return -1;
+}
+
+/* Unblocks the threads in sleep wheel SLOT that are due by NOW. */
+static void
+sleep_wheel_expire (int slot, int64_t now) {
+	struct list *bucket = &sleep_wheel[slot];
+	struct list_elem *e = list_begin (bucket);
+
+	while (e != list_end (bucket)) {
+		struct thread *t = list_entry (e, struct thread, elem);
 
-	while (now != list_end(&sleep_list)){	// sleep_list 순회
-		t = list_entry(now, struct thread, elem);	// 리스트 요소 now에 대한 포인터를 쓰레드 변환
-		
 		/* 쓰레드 깨울 시간 확인 */
-		if (t->wakeup_tick <= ticks){	// 깨울 시간이 현재 시간 이하라면 깨움
-			now = list_remove(&t->elem);	// sleep_list에서 삭제, now는 다음 쓰레드로 갱신 (return elem->next;)
-			thread_unblock(t);	// unblock status로 변경
-		}
-		else {	// 안깨움 (더 재움)
-			now = list_next(now);	// 다음 쓰레드 순회하도록 now 갱신
-		}
+		if (t->wakeup_tick <= now) {	// 깨울 시간이 현재 시간 이하라면 깨움
+			e = list_remove (e);
+			thread_unblock (t);
+		} else	// 다음 바퀴에 깨울 쓰레드
+			e = list_next (e);
 	}
+	if (list_empty (bucket))
+		sleep_wheel_mask[slot / 64] &= ~(1ULL << (slot % 64));
 }
 
+/* Yields the CPU if a ready thread has a higher priority than the
+   running thread.  In an interrupt handler the yield is deferred
+   until the handler returns. */
 void
 thread_test_preemption (void){
-	if (!list_empty(&ready_list) &&
-	thread_current()->priority 
-	<list_entry(list_front(&ready_list), struct thread, elem)->priority)
-		thread_yield();
+	if (thread_current ()->priority >= ready_queue_max_priority ())
+		return;
+	if (intr_context ())
+		intr_yield_on_return ();
+	else
+		thread_yield ();
 }
 
 /* Returns the name of the running thread. */
@@ -362,40 +492,83 @@ thread_yield (void) {
 
 	old_level = intr_disable ();	// 인터럽트 OFF
 	if (curr != idle_thread)	// 현재 쓰레드가 idle thread가 아니라면
-		// list_push_back (&ready_list, &curr->elem);	// ready list에 넣고
-		list_insert_ordered(&ready_list, &curr->elem, thread_compare_priority, 0);
+		ready_queue_push (curr);	// ready queue에 넣고
 	do_schedule (THREAD_READY);	// ready status로 바꿔줌
 	intr_set_level (old_level);	// 인터럽트 ON
 }
 
+/* Invoke function 'func' on all threads, passing along 'aux'.
+   The idle thread, which all_list leaves out, is included.
+   This function must be called with interrupts off. */
+void
+thread_foreach (thread_action_func *func, void *aux) {
+	struct list_elem *e;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	for (e = list_begin (&all_list); e != list_end (&all_list);
+			e = list_next (e))
+		func (list_entry (e, struct thread, all_elem), aux);
+	if (idle_thread != NULL)
+		func (idle_thread, aux);
+}
+
+/* 현재 recent_cpu, nice 값으로 priority 재계산.  priority가 바뀌면
+   ready queue에서도 옮겨진다. */
 void mlfqs_priority (struct thread *t){
-	/* 해당 Thread가 idle_thread인지 검사 */
-	ASSERT (t != idle_thread);
+	if (t == idle_thread)
+		return;
+
+	/* 밀린 recent_cpu decay 먼저 적용 */
+	mlfqs_recent_cpu (t);
 
 	/* priority 계산식 구현 */
-	t->priority = PRI_MAX - add_mixed((div_mixed(t->recent_cpu, 4)), (t->nice * 2));
+	int priority = PRI_MAX - fp_to_int (add_mixed (div_mixed (t->recent_cpu, 4), t->nice * 2));
 	// max 넘을 때는 max로, min 미만일 땐 min으로 설정
+	if (priority > PRI_MAX)
+		priority = PRI_MAX;
+	else if (priority < PRI_MIN)
+		priority = PRI_MIN;
+
+	thread_change_priority (t, priority);
 }
 
+/* Applies to T's recent_cpu the once-per-second decays it has
+   missed since it was last brought up to date.  The most recent
+   MLFQS_DECAY_HISTORY epochs are applied exactly; any older ones
+   are approximated with the oldest coefficient still on record. */
 void mlfqs_recent_cpu (struct thread *t){
-	/* 해당 Thread가 idle_thread인지 검사 */
-	ASSERT (t != idle_thread);	// if (t == idle_thread) {return;}
+	unsigned lag;
+
+	if (t == idle_thread)
+		return;
+
+	lag = decay_epoch - t->decay_epoch;
+	if (lag > MLFQS_DECAY_HISTORY) {
+		/* 오래된 epoch들: recent_cpu = c^k * recent_cpu + nice * (1 - c^k) / (1 - c) */
+		int coef = decay_coef[(decay_epoch + 1) % MLFQS_DECAY_HISTORY];
+		int coef_k = fp_pow (coef, lag - MLFQS_DECAY_HISTORY);
+		int one = int_to_fp (1);
+
+		t->recent_cpu = add_fp (mult_fp (coef_k, t->recent_cpu),
+				mult_mixed (div_fp (sub_fp (one, coef_k), sub_fp (one, coef)), t->nice));
+		lag = MLFQS_DECAY_HISTORY;
+	}
 
 	/* recent_cpu 계산식 구현 */
-	t->recent_cpu = add_mixed(mult_fp(div_fp(mult_mixed(load_avg, 2), add_mixed(mult_mixed(load_avg, 2), 1)), t->recent_cpu), t->nice);
-	// t->recent_cpu = add_mixed(mult_fp(div_fp(mult_fp(int_to_fp(2), load_avg), add_fp(mult_fp(int_to_fp(2), load_avg), int_to_fp(1))), t->recent_cpu), t->nice);
+	for (unsigned epoch = decay_epoch - lag + 1; lag > 0; lag--, epoch++)
+		t->recent_cpu = add_mixed (mult_fp (decay_coef[epoch % MLFQS_DECAY_HISTORY], t->recent_cpu), t->nice);
+	t->decay_epoch = decay_epoch;
 }
 
 void mlfqs_load_avg(void){
-	int ready_threads = list_size(&ready_list);	// size_t list_size (struct list *list) => parameter로 포인터 들어가야 하니까 주소값 넣어주기
+	int ready_threads = ready_cnt;
 	
 	struct thread *curr = thread_current();
 	if (curr != idle_thread)
 		ready_threads++;	// ?? 현재가 idle => null이므로 ready list 사이즈만, idle 아니면 +1 더해줌
 
 	/* load_avg 계산식을 구현 */
-	// load_avg = mult_fp(div_fp(int_to_fp(59), int_to_fp(60)), load_avg) + mult_mixed(div_fp((int_to_fp(1), int_to_fp(60)), ready_threads);
-	// load_avg = mult_fp(div_fp(int_to_fp(59), int_to_fp(60)), load_avg) + mult_mixed(div_fp((int_to_fp(1), int_to_fp(60)), int_to_fp(ready_threads));
 	load_avg = add_fp(mult_fp(div_fp(int_to_fp(59), int_to_fp(60)), load_avg), div_fp(int_to_fp(ready_threads), int_to_fp(60))); // 이렇게 해야 통과 ..!
 
 	/* load_avg 는 0 보다 작아질 수 없다.*/
@@ -408,42 +581,128 @@ void mlfqs_increment (void){
 	if (curr == idle_thread)return;
 
 	/* 현재 스레드의 recent_cpu 값을 1 증가시킨다. */
-	add_mixed(curr->recent_cpu, 1);
+	mlfqs_recent_cpu (curr);
+	curr->recent_cpu = add_mixed (curr->recent_cpu, 1);
 }
 
-/* ⭐모든 thread⭐의 recent_cpu와 priority값 재계산 */
+/* Starts a new recent_cpu decay epoch.  Called once per second,
+   after mlfqs_load_avg().  Only the running thread is decayed right
+   away; everyone else catches up in mlfqs_recent_cpu() when next
+   looked at, and mlfqs_sweep() makes sure that happens to every
+   thread within a bounded number of ticks. */
 void mlfqs_recalc (void){
-	// clock tick => timer_interrupt()에서 측정함.
+	int twice_load = mult_mixed (load_avg, 2);
 
-	/*
-	struct thread *curr = thread_current();
+	decay_epoch++;
+	decay_coef[decay_epoch % MLFQS_DECAY_HISTORY] = div_fp (twice_load, add_mixed (twice_load, 1));
 
-	// 4 clock tick마다 priority 재계산
-	if (clock tick % 4 == 0)
-		return mlfqs_priority(curr);
+	mlfqs_priority (thread_current ());
 
-	// 8 clock tick마다 recent_cpu 재계산
-	if (clock tick % 8 == 0)
-		return mlfqs_recent_cpu(curr);
-	*/
-	struct list_elem *e;
+	/* 진행 중인 sweep이 없으면 새로 시작 */
+	if (sweep_cursor == NULL) {
+		sweep_cursor = list_begin (&all_list);
+		sweep_epoch = decay_epoch;
+	}
+}
 
-	for (e = list_begin(&all_list); e != list_end(&all_list); e = list_next(&all_list)){
-		// 모든 "쓰레드"에 대해 재계산 => list_entry 사용
-		mlfqs_recent_cpu(list_entry(e, struct thread, all_elem));	// 리스트 요소 e에 대한 포인터를 쓰레드에 대한 포인터로 변환
-		mlfqs_priority(list_entry(e, struct thread, all_elem));	// 리스트 요소 e에 대한 포인터를 쓰레드에 대한 포인터로 변환
+/* Brings up to MLFQS_SWEEP_BATCH more threads of all_list up to
+   date, requeueing those whose priority changed.  Called on every
+   tick, so interrupt time stays bounded no matter how many threads
+   exist. */
+void mlfqs_sweep (void){
+	for (int n = 0; n < MLFQS_SWEEP_BATCH && sweep_cursor != NULL; n++) {
+		if (sweep_cursor == list_end (&all_list)) {
+			/* sweep 도중 epoch가 바뀌었으면 한 번 더 */
+			if (sweep_epoch != decay_epoch) {
+				sweep_cursor = list_begin (&all_list);
+				sweep_epoch = decay_epoch;
+			} else
+				sweep_cursor = NULL;
+			continue;
+		}
+
+		struct thread *t = list_entry (sweep_cursor, struct thread, all_elem);
+		sweep_cursor = list_next (sweep_cursor);
+		mlfqs_priority (t);
 	}
 }
 
+/* Returns X to the Nth power, for a fixed-point X. */
+static int
+fp_pow (int x, unsigned n) {
+	int result = int_to_fp (1);
+
+	while (n > 0) {
+		if (n & 1)
+			result = mult_fp (result, x);
+		x = mult_fp (x, x);
+		n >>= 1;
+	}
+	return result;
+}
+
 
 /* Sets the current thread's priority to NEW_PRIORITY. */
 void
 thread_set_priority (int new_priority) {
 	if (thread_mlfqs) return;	// mlfqs 스케줄러 활성화 => thread_mlfqs 변수는 true로 설정되고 우선순위 임의로 변경 불가함.
 
-	thread_current ()->priority = new_priority;
-	list_sort(&ready_list,thread_compare_priority,NULL);
+	enum intr_level old_level = intr_disable ();
+	struct thread *curr = thread_current ();
+
+	curr->base_priority = new_priority;
+	thread_refresh_priority (curr);	// donation 받은 priority가 더 높으면 유지
 	thread_test_preemption();	// yield와 같은 역할
+	intr_set_level (old_level);
+}
+
+/* Sets T's priority to PRIORITY, moving T to the matching ready
+   queue if it is currently waiting to run, and to its new place in
+   the wait queues it is in.  A ready thread may still be in a wait
+   queue: cond_wait() queues the thread before it releases the lock,
+   and may be preempted in between.  Does not preempt the running
+   thread. */
+void
+thread_change_priority (struct thread *t, int priority) {
+	enum intr_level old_level;
+
+	ASSERT (is_thread (t));
+	ASSERT (PRI_MIN <= priority && priority <= PRI_MAX);
+
+	old_level = intr_disable ();
+	if (t->priority != priority) {
+		if (t->status == THREAD_READY) {
+			ready_queue_remove (t);
+			t->priority = priority;
+			ready_queue_push (t);
+		} else
+			t->priority = priority;
+		waitq_rekey (t);	// 대기 중인 큐에서 위치 갱신
+	}
+	intr_set_level (old_level);
+}
+
+/* Recomputes T's effective priority as the higher of its base
+   priority and the highest priority donated through any lock it
+   holds.  Returns true if the effective priority changed. */
+bool
+thread_refresh_priority (struct thread *t) {
+	int priority = t->base_priority;
+	struct pheap_elem *top;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	top = pheap_max (&t->held_locks);
+	if (top != NULL) {
+		int donated = lock_donated_priority (pheap_entry (top, struct lock, held_elem));
+		if (donated > priority)
+			priority = donated;
+	}
+
+	if (priority == t->priority)
+		return false;
+	thread_change_priority (t, priority);
+	return true;
 }
 
 /* Returns the current thread's priority. */
@@ -452,13 +711,6 @@ thread_get_priority (void) {
 	return thread_current ()->priority;
 }
 
-bool 
-thread_compare_priority(struct list_elem *l, struct list_elem *s,
-void *aux UNUSED){
-	return list_entry(l, struct thread, elem)->priority 
-		> list_entry(s, struct thread, elem)->priority;	// l이 s보다 우선순위가 높으면 1 반환, 아니면 0 반환
-}
-
 /* Sets the current thread's nice value to NICE. */
 void
 thread_set_nice (int nice UNUSED) {
@@ -466,6 +718,7 @@ thread_set_nice (int nice UNUSED) {
 	old_level = intr_disable ();	// 인터럽트 비활성화
 
 	struct thread *curr = thread_current();
+	mlfqs_recent_cpu (curr);	// 이전 nice 값으로 밀린 decay 먼저 적용
 	curr->nice = nice;	// 현재 thread의 nice 값 변경
 
 	mlfqs_priority(curr);	// 변경 후에 현재 thread의 우선순위 재계산
@@ -506,6 +759,7 @@ thread_get_recent_cpu (void) {
 	old_level = intr_disable ();	// 인터럽트 비활성화
 
 	struct thread *curr = thread_current();
+	mlfqs_recent_cpu (curr);
 	int mult_recent_cpu_100 = fp_to_int(mult_mixed(curr->recent_cpu, 100));	// recent_cpu는 FP. 반올림 or 내림하는 이유는 ????
 	intr_set_level (old_level);	// 인터럽트 활성화
 
@@ -533,6 +787,17 @@ idle (void *idle_started_ UNUSED) {
 		intr_disable ();
 		thread_block ();
 
+		/* Zero free pages ahead of PAL_ZERO requests.  A thread
+		   that wakes up meanwhile preempts us, and we come back
+		   here when there is nothing to do again. */
+		intr_enable ();
+		if (palloc_zero_idle ())
+			continue;
+		intr_disable ();
+
+		/* Stop the periodic tick if nothing is due soon. */
+		timer_idle_enter ();
+
 		/* Re-enable interrupts and wait for the next one.
 
 		   The `sti' instruction disables interrupts until the
@@ -573,10 +838,14 @@ init_thread (struct thread *t, const char *name, int priority) {
 	strlcpy (t->name, name, sizeof t->name);
 	t->tf.rsp = (uint64_t) t + PGSIZE - sizeof (void *);
 	t->priority = priority;
+	t->base_priority = priority;
+	pheap_init (&t->held_locks, lock_donation_less, NULL);
+	list_init (&t->waitqs);
 	t->magic = THREAD_MAGIC;
 
 	t->nice = NICE_DEFAULT;
 	t->recent_cpu = RECENT_CPU_DEFAULT;
+	t->decay_epoch = decay_epoch;
 	if (t != idle_thread)
 		list_push_back(&all_list, &t->all_elem);	// all_list와 all_elem 연결
 }
@@ -588,10 +857,46 @@ init_thread (struct thread *t, const char *name, int priority) {
    idle_thread. */
 static struct thread *
 next_thread_to_run (void) {
-	if (list_empty (&ready_list))
+	int pri = ready_queue_max_priority ();
+	struct thread *t;
+
+	if (pri < PRI_MIN)
 		return idle_thread;
-	else
-		return list_entry (list_pop_front (&ready_list), struct thread, elem);
+
+	t = list_entry (list_front (&ready_queues[pri]), struct thread, elem);
+	ready_queue_remove (t);
+	return t;
+}
+
+/* Appends T to the back of the ready queue for its priority. */
+static void
+ready_queue_push (struct thread *t) {
+	ASSERT (intr_get_level () == INTR_OFF);
+	ASSERT (PRI_MIN <= t->priority && t->priority <= PRI_MAX);
+
+	list_push_back (&ready_queues[t->priority], &t->elem);
+	ready_mask |= 1ULL << t->priority;
+	ready_cnt++;
+}
+
+/* Removes T from the ready queue for its priority. */
+static void
+ready_queue_remove (struct thread *t) {
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	list_remove (&t->elem);
+	if (list_empty (&ready_queues[t->priority]))
+		ready_mask &= ~(1ULL << t->priority);
+	ready_cnt--;
+}
+
+/* Returns the highest priority of any ready thread, or
+   PRI_MIN - 1 if no thread is ready. */
+static int
+ready_queue_max_priority (void) {
+	if (ready_mask == 0)
+		return PRI_MIN - 1;
+	return 63 - __builtin_clzll (ready_mask);
 }
 
 /* Use iretq to launch the thread */
@@ -702,6 +1007,7 @@ do_schedule(int status) {
 	while (!list_empty (&destruction_req)) {
 		struct thread *victim =
 			list_entry (list_pop_front (&destruction_req), struct thread, elem);
+		palloc_reclaim_magazines (victim);
 		palloc_free_page(victim);
 	}
 	thread_current ()->status = status;
@@ -716,6 +1022,11 @@ schedule (void) {
 	ASSERT (intr_get_level () == INTR_OFF);
 	ASSERT (curr->status != THREAD_RUNNING);
 	ASSERT (is_thread (next));
+
+	/* Catch up on ticks skipped while idle. */
+	if (curr == idle_thread && next != idle_thread)
+		timer_idle_exit ();
+
 	/* Mark us as running. */
 	next->status = THREAD_RUNNING;
 
@@ -738,6 +1049,8 @@ schedule (void) {
 		if (curr && curr->status == THREAD_DYING && curr != initial_thread) {
 			ASSERT (curr != next);
 			list_push_back (&destruction_req, &curr->elem);
+			if (sweep_cursor == &curr->all_elem)
+				sweep_cursor = list_next (sweep_cursor);
 			list_remove (&curr->all_elem);	// mlfqs all_list에서 all_elem 빼는 과정
 		}
 
@@ -574,13 +574,6 @@ install_page (void *upage, void *kpage, bool writable) {
  * If you want to implement the function for only project 2, implement it on the
  * upper block. */
 
-static bool
-lazy_load_segment (struct page *page, void *aux) {
-	/* TODO: Load the segment from the file */
-	/* TODO: This called when the first page fault occurs on address VA. */
-	/* TODO: VA is available when calling this function. */
-}
-
 /* Loads a segment starting at offset OFS in FILE at address
  * UPAGE.  In total, READ_BYTES + ZERO_BYTES bytes of virtual
  * memory are initialized, as follows:
@@ -609,16 +602,37 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
 		size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
 		size_t page_zero_bytes = PGSIZE - page_read_bytes;
 
-		/* TODO: Set up aux to pass information to the lazy_load_segment. */
-		void *aux = NULL;
-		if (!vm_alloc_page_with_initializer (VM_ANON, upage,
-					writable, lazy_load_segment, aux))
-			return false;
+		/* Read-only segments stay backed by FILE, so that their
+		 * pages can be dropped under memory pressure and mapped
+		 * around faults; writable ones become anonymous once
+		 * loaded, and need nothing from FILE if all zeros. */
+		if (writable && page_read_bytes == 0) {
+			if (!vm_alloc_page (VM_ANON, upage, true))
+				return false;
+		} else {
+			struct file_page *aux = file_page_create (file, ofs,
+					page_read_bytes);
+			if (aux == NULL)
+				return false;
+			/* Text is shared between processes through the text
+			 * cache, so the file may not change while any of it
+			 * is mapped.  The handle keeps writes denied until
+			 * the page is destroyed, and so do its copies. */
+			aux->text = !writable;
+			if (aux->text)
+				file_deny_write (aux->file);
+			if (!vm_alloc_page_with_initializer (writable ? VM_ANON : VM_FILE,
+						upage, writable, file_page_load, aux)) {
+				file_page_free (aux);
+				return false;
+			}
+		}
 
 		/* Advance. */
 		read_bytes -= page_read_bytes;
 		zero_bytes -= page_zero_bytes;
 		upage += PGSIZE;
+		ofs += page_read_bytes;
 	}
 	return true;
 }
@@ -1,7 +1,13 @@
 /* anon.c: Implementation of page for non-disk image (a.k.a. anonymous page). */
 
 #include "vm/vm.h"
+#include <bitmap.h>
+#include <stdio.h>
+#include <string.h>
 #include "devices/disk.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
 
 /* DO NOT MODIFY BELOW LINE */
 static struct disk *swap_disk;
@@ -17,36 +23,185 @@ static const struct page_operations anon_ops = {
 	.type = VM_ANON,
 };
 
+/* The swap disk is divided into page-sized slots.  A set bit in
+ * SWAP_SLOTS marks a slot in use, and SLOT_REFS counts the pages
+ * in each slot: more than one if a page shared copy-on-write was
+ * evicted. */
+#define SECTORS_PER_SLOT (PGSIZE / DISK_SECTOR_SIZE)
+static struct bitmap *swap_slots;
+static unsigned *slot_refs;
+static struct lock swap_lock;
+
+/* Statistics. */
+static long long out_page_cnt;      /* Pages written to swap. */
+static long long out_cmd_cnt;       /* Disk commands used to write them. */
+static long long in_page_cnt;       /* Pages read from swap. */
+static long long in_cmd_cnt;        /* Disk commands used to read them. */
+
 /* Initialize the data for anonymous pages */
 void
 vm_anon_init (void) {
-	/* TODO: Set up the swap_disk. */
-	swap_disk = NULL;
+	swap_disk = disk_get (1, 1);
+	swap_slots = bitmap_create (swap_disk != NULL
+			? disk_size (swap_disk) / SECTORS_PER_SLOT : 0);
+	if (swap_slots == NULL)
+		PANIC ("couldn't allocate swap slot bitmap");
+	slot_refs = calloc (bitmap_size (swap_slots), sizeof *slot_refs);
+	if (slot_refs == NULL && bitmap_size (swap_slots) > 0)
+		PANIC ("couldn't allocate swap slot reference counts");
+	lock_init (&swap_lock);
+}
+
+/* Prints swap statistics. */
+void
+anon_print_stats (void) {
+	printf ("Swap: %zu of %zu slots in use, "
+			"%lld pages out in %lld writes, %lld pages in in %lld reads\n",
+			bitmap_count (swap_slots, 0, bitmap_size (swap_slots), true),
+			bitmap_size (swap_slots),
+			out_page_cnt, out_cmd_cnt, in_page_cnt, in_cmd_cnt);
 }
 
 /* Initialize the file mapping */
 bool
-anon_initializer (struct page *page, enum vm_type type, void *kva) {
+anon_initializer (struct page *page, enum vm_type type UNUSED, void *kva) {
 	/* Set up the handler */
 	page->operations = &anon_ops;
 
 	struct anon_page *anon_page = &page->anon;
+	anon_page->slot = SWAP_SLOT_NONE;
+
+	/* The frame may have belonged to someone else. */
+	memset (kva, 0, PGSIZE);
+	return true;
+}
+
+/* Drops a reference to swap slot SLOT, releasing the slot when
+ * the last page in it lets go.  The caller must hold SWAP_LOCK. */
+static void
+put_slot (size_t slot) {
+	ASSERT (slot_refs[slot] > 0);
+	if (--slot_refs[slot] == 0)
+		bitmap_reset (swap_slots, slot);
+}
+
+/* Drops a reference to swap slot SLOT. */
+static void
+free_slot (size_t slot) {
+	lock_acquire (&swap_lock);
+	put_slot (slot);
+	lock_release (&swap_lock);
+}
+
+/* Puts SHARER, which shares PAGE copy-on-write, into the swap
+ * slot that holds PAGE. */
+void
+anon_swap_share (struct page *page, struct page *sharer) {
+	ASSERT (page->anon.slot != SWAP_SLOT_NONE);
+	ASSERT (sharer->anon.slot == SWAP_SLOT_NONE);
+
+	lock_acquire (&swap_lock);
+	slot_refs[page->anon.slot]++;
+	lock_release (&swap_lock);
+	sharer->anon.slot = page->anon.slot;
+}
+
+/* Reads the CNT pages in PAGES, which are in consecutive swap
+ * slots, into the frames at KVAS with a single disk command, and
+ * drops their references to the slots. */
+void
+anon_swap_in_cluster (struct page *pages[], void *kvas[], size_t cnt) {
+	void *sectors[SWAP_CLUSTER * SECTORS_PER_SLOT];
+	size_t slot = pages[0]->anon.slot;
+	size_t i, j;
+
+	ASSERT (cnt > 0 && cnt <= SWAP_CLUSTER);
+
+	for (i = 0; i < cnt; i++) {
+		ASSERT (pages[i]->anon.slot == slot + i);
+		for (j = 0; j < SECTORS_PER_SLOT; j++)
+			sectors[i * SECTORS_PER_SLOT + j] = kvas[i] + j * DISK_SECTOR_SIZE;
+	}
+	disk_read_multiple (swap_disk, slot * SECTORS_PER_SLOT, sectors,
+			cnt * SECTORS_PER_SLOT);
+
+	lock_acquire (&swap_lock);
+	for (i = 0; i < cnt; i++) {
+		put_slot (slot + i);
+		pages[i]->anon.slot = SWAP_SLOT_NONE;
+	}
+	lock_release (&swap_lock);
+
+	in_page_cnt += cnt;
+	in_cmd_cnt++;
+}
+
+/* Writes the CNT pages in PAGES, which must be anonymous pages in
+ * memory, to consecutive swap slots with a single disk command, so
+ * that they can later be read back together.  If there are not CNT
+ * free slots in a row, writes only PAGES[0].  Returns the number of
+ * pages written, from the start of PAGES, which is 0 only if swap
+ * is full.  The caller must unmap the pages it wrote. */
+size_t
+anon_swap_out_cluster (struct page *pages[], size_t cnt) {
+	const void *sectors[SWAP_CLUSTER * SECTORS_PER_SLOT];
+	size_t slot;
+	size_t i, j;
+
+	ASSERT (cnt > 0 && cnt <= SWAP_CLUSTER);
+
+	lock_acquire (&swap_lock);
+	slot = bitmap_scan_and_flip_next (swap_slots, cnt, false);
+	if (slot == BITMAP_ERROR && cnt > 1) {
+		cnt = 1;
+		slot = bitmap_scan_and_flip_next (swap_slots, cnt, false);
+	}
+	if (slot != BITMAP_ERROR)
+		for (i = 0; i < cnt; i++)
+			slot_refs[slot + i] = 1;
+	lock_release (&swap_lock);
+	if (slot == BITMAP_ERROR)
+		return 0;
+
+	for (i = 0; i < cnt; i++) {
+		const uint8_t *kva = pages[i]->frame->kva;
+
+		for (j = 0; j < SECTORS_PER_SLOT; j++)
+			sectors[i * SECTORS_PER_SLOT + j] = kva + j * DISK_SECTOR_SIZE;
+		pages[i]->anon.slot = slot + i;
+	}
+	disk_write_multiple (swap_disk, slot * SECTORS_PER_SLOT, sectors,
+			cnt * SECTORS_PER_SLOT);
+
+	out_page_cnt += cnt;
+	out_cmd_cnt++;
+	return cnt;
 }
 
 /* Swap in the page by read contents from the swap disk. */
 static bool
 anon_swap_in (struct page *page, void *kva) {
 	struct anon_page *anon_page = &page->anon;
+
+	if (anon_page->slot == SWAP_SLOT_NONE)
+		return false;
+	anon_swap_in_cluster (&page, &kva, 1);
+	return true;
 }
 
 /* Swap out the page by writing contents to the swap disk. */
 static bool
 anon_swap_out (struct page *page) {
-	struct anon_page *anon_page = &page->anon;
+	return anon_swap_out_cluster (&page, 1) == 1;
 }
 
 /* Destroy the anonymous page. PAGE will be freed by the caller. */
 static void
 anon_destroy (struct page *page) {
 	struct anon_page *anon_page = &page->anon;
+
+	if (anon_page->slot != SWAP_SLOT_NONE) {
+		free_slot (anon_page->slot);
+		anon_page->slot = SWAP_SLOT_NONE;
+	}
 }
@@ -1,6 +1,10 @@
 /* file.c: Implementation of memory backed file object (mmaped object). */
 
 #include "vm/vm.h"
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/mmu.h"
+#include "threads/vaddr.h"
 
 static bool file_backed_swap_in (struct page *page, void *kva);
 static bool file_backed_swap_out (struct page *page);
@@ -19,40 +23,239 @@ void
 vm_file_init (void) {
 }
 
-/* Initialize the file backed page */
+/* Initialize the file backed page.  PAGE is still uninitialized,
+ * and its AUX is the `struct file_page' passed to
+ * file_page_load(), whose file PAGE takes over. */
 bool
-file_backed_initializer (struct page *page, enum vm_type type, void *kva) {
+file_backed_initializer (struct page *page, enum vm_type type UNUSED,
+		void *kva UNUSED) {
+	struct file_page *load = page->uninit.aux;
+
 	/* Set up the handler */
 	page->operations = &file_ops;
 
 	struct file_page *file_page = &page->file;
+	*file_page = *load;
+	return true;
+}
+
+/* Returns a new description of a page that holds READ_BYTES bytes
+ * of FILE at OFS followed by zeros, with a handle of its own to
+ * FILE, or a null pointer if memory is short.  It is meant as the
+ * AUX of file_page_load(). */
+struct file_page *
+file_page_create (struct file *file, off_t ofs, size_t read_bytes) {
+	struct file_page *load;
+
+	ASSERT (read_bytes <= PGSIZE);
+
+	load = malloc (sizeof *load);
+	if (load == NULL)
+		return NULL;
+	load->file = file_reopen (file);
+	if (load->file == NULL) {
+		free (load);
+		return NULL;
+	}
+	load->ofs = ofs;
+	load->read_bytes = read_bytes;
+	load->text = false;
+	load->map_addr = NULL;
+	return load;
+}
+
+/* Returns a copy of LOAD for a forked child, or a null pointer if
+ * memory is short. */
+struct file_page *
+file_page_duplicate (const struct file_page *load) {
+	struct file_page *copy = file_page_create (load->file, load->ofs,
+			load->read_bytes);
+
+	if (copy != NULL) {
+		copy->text = load->text;
+		copy->map_addr = load->map_addr;
+	}
+	return copy;
+}
+
+/* Frees LOAD, which was never used to load a page. */
+void
+file_page_free (struct file_page *load) {
+	file_close (load->file);
+	free (load);
+}
+
+/* Reads the page described by LOAD into KVA. */
+static bool
+read_page (const struct file_page *load, void *kva) {
+	if (file_read_at (load->file, kva, load->read_bytes, load->ofs)
+			!= (off_t) load->read_bytes)
+		return false;
+	memset (kva + load->read_bytes, 0, PGSIZE - load->read_bytes);
+	return true;
+}
+
+/* Loads PAGE from the file, as described by AUX, a `struct
+ * file_page' from file_page_create().  Serves both the pages of
+ * mappings, which are file-backed and keep AUX's file, and the
+ * writable segments of executables, which become anonymous once
+ * loaded.  Frees AUX. */
+bool
+file_page_load (struct page *page, void *aux) {
+	struct file_page *load = aux;
+	bool success = read_page (load, page->frame->kva);
+
+	if (page_get_type (page) != VM_FILE)
+		file_close (load->file);
+	free (load);
+	return success;
+}
+
+/* Returns where the contents of PAGE, a file-backed page that may
+ * not have been loaded yet, come from. */
+struct file_page *
+file_page_source (struct page *page) {
+	if (VM_TYPE (page->operations->type) == VM_UNINIT)
+		return page->uninit.aux;
+	return &page->file;
+}
+
+/* Turns PAGE, a file-backed page that may not have been loaded
+ * yet, into a loaded one without reading the file, because its
+ * contents are already in a frame. */
+void
+file_page_skip_load (struct page *page) {
+	if (VM_TYPE (page->operations->type) == VM_UNINIT) {
+		struct file_page *load = page->uninit.aux;
+
+		file_backed_initializer (page, VM_FILE, NULL);
+		free (load);
+	}
+}
+
+/* Returns true if PAGE and NEXT are file-backed pages of one
+ * mapping, or of one segment of an executable: they have the same
+ * permissions, and NEXT holds the part of the same file that lies
+ * as far past PAGE's part as NEXT lies past PAGE in memory. */
+bool
+file_page_adjacent (struct page *page, struct page *next) {
+	struct file_page *a, *b;
+
+	if (page_get_type (page) != VM_FILE || page_get_type (next) != VM_FILE
+			|| page->writable != next->writable)
+		return false;
+
+	a = file_page_source (page);
+	b = file_page_source (next);
+	return (a->map_addr == b->map_addr
+			&& file_get_inode (a->file) == file_get_inode (b->file)
+			&& (int64_t) b->ofs - a->ofs == next->va - page->va);
 }
 
 /* Swap in the page by read contents from the file. */
 static bool
 file_backed_swap_in (struct page *page, void *kva) {
-	struct file_page *file_page UNUSED = &page->file;
+	struct file_page *file_page = &page->file;
+
+	return read_page (file_page, kva);
+}
+
+/* Writes PAGE back to its file if it was written since it was
+ * loaded or last written back. */
+static void
+write_back (struct page *page) {
+	struct file_page *file_page = &page->file;
+	uint64_t *pml4 = page->owner->pml4;
+
+	if (page->dirty || pml4_is_dirty (pml4, page->va)) {
+		file_write_at (file_page->file, page->frame->kva,
+				file_page->read_bytes, file_page->ofs);
+		pml4_set_dirty (pml4, page->va, false);
+		page->dirty = false;
+	}
 }
 
 /* Swap out the page by writeback contents to the file. */
 static bool
 file_backed_swap_out (struct page *page) {
-	struct file_page *file_page UNUSED = &page->file;
+	write_back (page);
+	return true;
 }
 
 /* Destory the file backed page. PAGE will be freed by the caller. */
 static void
 file_backed_destroy (struct page *page) {
-	struct file_page *file_page UNUSED = &page->file;
+	struct file_page *file_page = &page->file;
+
+	if (page->frame != NULL)
+		write_back (page);
+	file_close (file_page->file);
+	file_page->file = NULL;
 }
 
 /* Do the mmap */
 void *
 do_mmap (void *addr, size_t length, int writable,
 		struct file *file, off_t offset) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	off_t file_len = file_length (file);
+	size_t read_left;
+	uint8_t *upage;
+
+	if (addr == NULL || pg_ofs (addr) != 0 || length == 0
+			|| offset < 0 || offset % PGSIZE != 0
+			|| (uint64_t) addr + length < (uint64_t) addr
+			|| !is_user_vaddr (addr) || !is_user_vaddr (addr + length - 1))
+		return NULL;
+	for (upage = addr; upage < (uint8_t *) addr + length; upage += PGSIZE)
+		if (spt_find_page (spt, upage) != NULL)
+			return NULL;
+
+	read_left = offset < file_len ? (size_t) (file_len - offset) : 0;
+	if (read_left > length)
+		read_left = length;
+
+	for (upage = addr; upage < (uint8_t *) addr + length; upage += PGSIZE) {
+		size_t page_read_bytes = read_left < PGSIZE ? read_left : PGSIZE;
+		struct file_page *load = file_page_create (file, offset,
+				page_read_bytes);
+
+		if (load != NULL)
+			load->map_addr = addr;
+		if (load == NULL
+				|| !vm_alloc_page_with_initializer (VM_FILE, upage, writable,
+					file_page_load, load)) {
+			if (load != NULL)
+				file_page_free (load);
+			if (upage != addr)
+				do_munmap (addr);
+			return NULL;
+		}
+		read_left -= page_read_bytes;
+		offset += PGSIZE;
+	}
+	return addr;
+}
+
+/* Returns true if PAGE belongs to the mapping that starts at
+ * ADDR. */
+static bool
+in_mapping (struct page *page, void *addr) {
+	return (page != NULL && page_get_type (page) == VM_FILE
+			&& file_page_source (page)->map_addr == addr);
 }
 
 /* Do the munmap */
 void
 do_munmap (void *addr) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	uint8_t *upage;
+
+	for (upage = addr; ; upage += PGSIZE) {
+		struct page *page = spt_find_page (spt, upage);
+
+		if (!in_mapping (page, addr))
+			break;
+		spt_remove_page (spt, page);
+	}
 }
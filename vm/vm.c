@@ -1,9 +1,52 @@
 /* vm.c: Generic interface for virtual memory objects. */
 
+#include <stdio.h>
+#include <string.h>
 #include "threads/malloc.h"
+#include "threads/mmu.h"
+#include "threads/pte.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
 #include "vm/vm.h"
 #include "vm/inspect.h"
 
+/* Allocators for `struct page' and `struct frame'. */
+static struct kmem_cache page_objs;
+static struct kmem_cache frame_objs;
+
+/* Frame table: every frame that holds a user page, in CLOCK order.
+ * The hand points at the next frame to consider for eviction. */
+static struct list frame_table;
+static struct list_elem *clock_hand;
+static size_t frame_cnt;
+static struct lock frame_lock;
+
+/* Text cache: read-only file-backed frames, such as the text of
+ * running programs, by inode and offset, so that every process
+ * that maps the same part of the same file shares one frame.
+ * Protected by frame_lock. */
+static struct hash text_cache;
+
+/* Most pages, including the faulting one, that a fault on a
+ * file-backed page maps at once.  Set with -fa=PAGES; 1 turns
+ * fault-around off. */
+size_t fault_around_pages = 16;
+
+/* Statistics. */
+static long long fault_cnt;         /* Page faults handled. */
+static long long load_cnt;          /* Pages loaded into frames. */
+static long long around_cnt;        /* Pages mapped around faults. */
+static long long evict_cnt;         /* Frames evicted. */
+static long long clean_evict_cnt;   /* Clean file-backed frames evicted. */
+static long long readahead_cnt;     /* Pages read ahead from swap. */
+static long long cow_share_cnt;     /* Frames shared by fork(). */
+static long long cow_copy_cnt;      /* Shared frames copied on write. */
+static long long text_share_cnt;    /* Pages mapped from the text cache. */
+static size_t peak_frame_cnt;       /* Most frames in use at once. */
+
+static hash_hash_func text_hash;
+static hash_less_func text_less;
+
 /* Initializes the virtual memory subsystem by invoking each subsystem's
  * intialize codes. */
 void
@@ -15,7 +58,34 @@ vm_init (void) {
 #endif
 	register_inspect_intr ();
 	/* DO NOT MODIFY UPPER LINES. */
-	/* TODO: Your code goes here. */
+	kmem_cache_init (&page_objs, "page", sizeof (struct page), NULL);
+	kmem_cache_init (&frame_objs, "frame", sizeof (struct frame), NULL);
+	list_init (&frame_table);
+	clock_hand = NULL;
+	lock_init (&frame_lock);
+	hash_init (&text_cache, text_hash, text_less, NULL);
+}
+
+/* Prints virtual memory statistics. */
+void
+vm_print_stats (void) {
+	printf ("VM: %lld page faults, %lld evictions (%lld clean), "
+			"%zu frames in use\n",
+			fault_cnt, evict_cnt, clean_evict_cnt, frame_cnt);
+	if (fault_cnt > 0)
+		printf ("VM: %lld evictions per 1000 faults, "
+				"%lld pages read ahead from swap\n",
+				evict_cnt * 1000 / fault_cnt, readahead_cnt);
+	if (load_cnt > 0)
+		printf ("VM: %lld pages loaded, %lld around faults, "
+				"%lld faults per MB loaded\n",
+				load_cnt, around_cnt, fault_cnt * (1 << 20) / PGSIZE / load_cnt);
+	printf ("VM: %lld pages shared on fork, %lld copied on write\n",
+			cow_share_cnt, cow_copy_cnt);
+	printf ("VM: %lld pages mapped from the text cache, "
+			"%zu frames cached, at most %zu frames in use\n",
+			text_share_cnt, hash_size (&text_cache), peak_frame_cnt);
+	anon_print_stats ();
 }
 
 /* Get the type of the page. This function is useful if you want to know the
@@ -36,6 +106,8 @@ page_get_type (struct page *page) {
 static struct frame *vm_get_victim (void);
 static bool vm_do_claim_page (struct page *page);
 static struct frame *vm_evict_frame (void);
+static bool vm_map_frame (struct page *page, struct frame *frame);
+static void vm_fault_around (struct page *page);
 
 /* Create the pending page object with initializer. If you want to create a
  * page, do not create it directly and make it through this function or
@@ -44,77 +116,699 @@ bool
 vm_alloc_page_with_initializer (enum vm_type type, void *upage, bool writable,
 		vm_initializer *init, void *aux) {
 
-	ASSERT (VM_TYPE(type) != VM_UNINIT)
+	ASSERT (VM_TYPE(type) != VM_UNINIT);
 
 	struct supplemental_page_table *spt = &thread_current ()->spt;
 
 	/* Check wheter the upage is already occupied or not. */
 	if (spt_find_page (spt, upage) == NULL) {
-		/* TODO: Create the page, fetch the initialier according to the VM type,
-		 * TODO: and then create "uninit" page struct by calling uninit_new. You
-		 * TODO: should modify the field after calling the uninit_new. */
+		bool (*initializer) (struct page *, enum vm_type, void *);
+		struct page *page;
+
+		switch (VM_TYPE (type)) {
+			case VM_ANON:
+				initializer = anon_initializer;
+				break;
+			case VM_FILE:
+				initializer = file_backed_initializer;
+				break;
+			default:
+				goto err;
+		}
+
+		page = kmem_cache_alloc (&page_objs);
+		if (page == NULL)
+			goto err;
+		uninit_new (page, upage, init, type, aux, initializer);
+		page->writable = writable;
+		page->owner = thread_current ();
 
-		/* TODO: Insert the page into the spt. */
+		if (!spt_insert_page (spt, page)) {
+			kmem_cache_free (&page_objs, page);
+			goto err;
+		}
+		return true;
 	}
 err:
 	return false;
 }
 
+/* Shape of the supplemental page table: SPT_LEVELS levels of
+ * SPT_FANOUT-entry nodes.  Level 0 holds the leaves. */
+#define SPT_LEVELS 4
+#define SPT_FANOUT (PGSIZE / sizeof (void *))
+
+/* Virtual address shift of each level's index. */
+static const unsigned spt_shift[SPT_LEVELS] = {
+	PTXSHIFT, PDXSHIFT, PDPESHIFT, PML4SHIFT,
+};
+
+/* End of the address space the table covers. */
+#define SPT_END (1UL << (PML4SHIFT + 9))
+
+/* Returns the index into a node at LEVEL for virtual address VA. */
+static inline size_t
+spt_index (uint64_t va, int level) {
+	return (va >> spt_shift[level]) & (SPT_FANOUT - 1);
+}
+
+/* Returns the leaf node of SPT that covers VA, or NULL if there
+ * is none.  Leaves the lookup cache alone, so that it is safe to
+ * use on another thread's table. */
+static void **
+spt_walk_leaf (struct supplemental_page_table *spt, uint64_t va) {
+	void **node = spt->root;
+	int level;
+
+	for (level = SPT_LEVELS - 1; node != NULL && level > 0; level--)
+		node = node[spt_index (va, level)];
+	return node;
+}
+
+/* Returns the leaf node of SPT that covers VA, or NULL if there
+ * is none. */
+static void **
+spt_find_leaf (struct supplemental_page_table *spt, uint64_t va) {
+	void **node;
+
+	if (spt->leaf != NULL && spt->leaf_tag == va >> PDXSHIFT)
+		return spt->leaf;
+
+	node = spt_walk_leaf (spt, va);
+	if (node != NULL) {
+		spt->leaf = node;
+		spt->leaf_tag = va >> PDXSHIFT;
+	}
+	return node;
+}
+
 /* Find VA from spt and return page. On error, return NULL. */
 struct page *
-spt_find_page (struct supplemental_page_table *spt UNUSED, void *va UNUSED) {
-	struct page *page = NULL;
-	/* TODO: Fill this function. */
+spt_find_page (struct supplemental_page_table *spt, void *va) {
+	void **leaf;
+
+	if (!is_user_vaddr (va))
+		return NULL;
 
-	return page;
+	leaf = spt_find_leaf (spt, (uint64_t) va);
+	return leaf != NULL ? leaf[PTX (va)] : NULL;
 }
 
 /* Insert PAGE into spt with validation. */
 bool
-spt_insert_page (struct supplemental_page_table *spt UNUSED,
-		struct page *page UNUSED) {
-	int succ = false;
-	/* TODO: Fill this function. */
+spt_insert_page (struct supplemental_page_table *spt, struct page *page) {
+	uint64_t va = (uint64_t) page->va;
+	void **node, **slot;
+	int level;
+
+	if (pg_ofs (page->va) != 0 || !is_user_vaddr (page->va))
+		return false;
+
+	/* Walk down, creating missing nodes.  Nodes left empty by a
+	 * failed allocation are freed along with the rest of the table
+	 * by supplemental_page_table_kill(). */
+	slot = (void **) &spt->root;
+	for (level = SPT_LEVELS; level > 0; level--) {
+		if (*slot == NULL) {
+			*slot = palloc_get_page (PAL_ZERO);
+			if (*slot == NULL)
+				return false;
+			spt->node_cnt++;
+		}
+		node = *slot;
+		slot = &node[spt_index (va, level - 1)];
+	}
 
-	return succ;
+	if (*slot != NULL)
+		return false;
+	*slot = page;
+	spt->page_cnt++;
+	return true;
 }
 
 void
 spt_remove_page (struct supplemental_page_table *spt, struct page *page) {
-	vm_dealloc_page (page);
+	spt_remove_range (spt, page->va, page->va + PGSIZE);
+}
+
+/* Returns true if NODE has no entries. */
+static bool
+spt_node_empty (void **node) {
+	size_t i;
+
+	for (i = 0; i < SPT_FANOUT; i++)
+		if (node[i] != NULL)
+			return false;
+	return true;
+}
+
+/* Returns the first and last index into a node at LEVEL that
+ * covers addresses from BASE, for entries that overlap
+ * [START, END).  Returns false if there are none. */
+static bool
+spt_clip (int level, uint64_t base, uint64_t start, uint64_t end,
+		size_t *first, size_t *last) {
+	unsigned shift = spt_shift[level];
+	uint64_t limit = base + (SPT_FANOUT << shift);
+
+	if (start < base)
+		start = base;
+	if (end > limit)
+		end = limit;
+	if (start >= end)
+		return false;
+
+	*first = (start - base) >> shift;
+	*last = (end - 1 - base) >> shift;
+	return true;
+}
+
+/* Calls FUNC for each page in [START, END) under NODE, which is at
+ * LEVEL and covers addresses from BASE, in address order.
+ * Returns false if FUNC did. */
+static bool
+spt_node_for_each (void **node, int level, uint64_t base,
+		uint64_t start, uint64_t end, spt_for_each_func *func, void *aux) {
+	size_t i, first, last;
+
+	if (!spt_clip (level, base, start, end, &first, &last))
+		return true;
+
+	for (i = first; i <= last; i++) {
+		if (node[i] == NULL)
+			continue;
+		if (level == 0) {
+			if (!func (node[i], aux))
+				return false;
+		} else if (!spt_node_for_each (node[i], level - 1,
+					base + (i << spt_shift[level]), start, end, func, aux))
+			return false;
+	}
+	return true;
+}
+
+/* Calls FUNC for each page of SPT in [START, END), in address
+ * order, skipping unpopulated parts of the range at the cost of
+ * one node visit each.  Stops and returns false as soon as FUNC
+ * returns false; otherwise returns true.  FUNC must not add or
+ * remove pages. */
+bool
+spt_for_each (struct supplemental_page_table *spt, void *start, void *end,
+		spt_for_each_func *func, void *aux) {
+	if (spt->root == NULL)
+		return true;
+	return spt_node_for_each (spt->root, SPT_LEVELS - 1, 0,
+			(uint64_t) start, (uint64_t) end, func, aux);
+}
+
+/* Removes and deallocates the pages in [START, END) under NODE,
+ * which is at LEVEL and covers addresses from BASE, and frees the
+ * nodes below it that are left empty.  Returns true if NODE is
+ * now empty. */
+static bool
+spt_node_remove (struct supplemental_page_table *spt, void **node, int level,
+		uint64_t base, uint64_t start, uint64_t end) {
+	size_t i, first, last;
+
+	if (!spt_clip (level, base, start, end, &first, &last))
+		return spt_node_empty (node);
+
+	for (i = first; i <= last; i++) {
+		void *entry = node[i];
+
+		if (entry == NULL)
+			continue;
+		if (level == 0) {
+			node[i] = NULL;
+			spt->page_cnt--;
+			vm_dealloc_page (entry);
+		} else if (spt_node_remove (spt, entry, level - 1,
+					base + (i << spt_shift[level]), start, end)) {
+			node[i] = NULL;
+			palloc_free_page (entry);
+			spt->node_cnt--;
+			if (spt->leaf == entry)
+				spt->leaf = NULL;
+		}
+	}
+
+	/* A node whose whole span was removed is empty without
+	 * looking. */
+	if (first == 0 && last == SPT_FANOUT - 1)
+		return true;
+	return spt_node_empty (node);
+}
+
+/* Removes and deallocates every page of SPT in [START, END), as
+ * for munmap() or process exit, and frees the nodes that no
+ * longer hold any pages. */
+void
+spt_remove_range (struct supplemental_page_table *spt, void *start,
+		void *end) {
+	if (spt->root == NULL)
+		return;
+	if (spt_node_remove (spt, spt->root, SPT_LEVELS - 1, 0,
+				(uint64_t) start, (uint64_t) end)) {
+		palloc_free_page (spt->root);
+		spt->root = NULL;
+		spt->node_cnt--;
+		spt->leaf = NULL;
+	}
+}
+
+/* Adds FRAME to the frame table, just behind the clock hand so
+ * that it is considered last. */
+static void
+frame_table_add (struct frame *frame) {
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	if (clock_hand != NULL && clock_hand != list_end (&frame_table))
+		list_insert (clock_hand, &frame->elem);
+	else
+		list_push_back (&frame_table, &frame->elem);
+	if (++frame_cnt > peak_frame_cnt)
+		peak_frame_cnt = frame_cnt;
+}
+
+/* Removes FRAME from the frame table. */
+static void
+frame_table_remove (struct frame *frame) {
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	if (clock_hand == &frame->elem)
+		clock_hand = list_next (clock_hand);
+	list_remove (&frame->elem);
+	frame_cnt--;
+	if (frame->inode != NULL) {
+		hash_delete (&text_cache, &frame->cache_elem);
+		frame->inode = NULL;
+	}
+}
+
+/* Makes FRAME the frame of PAGE, which is mapped into its owner's
+ * address space.  The first page is FRAME's primary page: the
+ * page table and supplemental page table that eviction consults
+ * are its owner's. */
+static void
+frame_add_page (struct frame *frame, struct page *page) {
+	page->frame = frame;
+	list_push_back (&frame->pages, &page->share_elem);
+	if (frame->ref_cnt++ == 0) {
+		frame->page = page;
+		frame->pml4 = page->owner->pml4;
+		frame->spt = &page->owner->spt;
+	}
+}
+
+/* Detaches PAGE, which the caller has already unmapped, from its
+ * frame and returns the number of pages still sharing the frame.
+ * If PAGE was the primary page, the next sharer takes its place. */
+static size_t
+frame_remove_page (struct frame *frame, struct page *page) {
+	ASSERT (page->frame == frame);
+	ASSERT (frame->ref_cnt > 0);
+
+	list_remove (&page->share_elem);
+	page->frame = NULL;
+	if (--frame->ref_cnt > 0 && frame->page == page) {
+		struct page *next = list_entry (list_front (&frame->pages),
+				struct page, share_elem);
+
+		frame->page = next;
+		frame->pml4 = next->owner->pml4;
+		frame->spt = &next->owner->spt;
+	}
+	return frame->ref_cnt;
+}
+
+/* Returns a hash value for the text cache key of frame E. */
+static uint64_t
+text_hash (const struct hash_elem *e, void *aux UNUSED) {
+	const struct frame *frame = hash_entry (e, struct frame, cache_elem);
+
+	return (hash_bytes (&frame->inode, sizeof frame->inode)
+			^ hash_int (frame->ofs));
+}
+
+/* Returns true if the text cache key of frame A precedes B's. */
+static bool
+text_less (const struct hash_elem *a_, const struct hash_elem *b_,
+		void *aux UNUSED) {
+	const struct frame *a = hash_entry (a_, struct frame, cache_elem);
+	const struct frame *b = hash_entry (b_, struct frame, cache_elem);
+
+	if (a->inode != b->inode)
+		return a->inode < b->inode;
+	return a->ofs < b->ofs;
+}
+
+/* Returns true if PAGE, which may not have been loaded yet, holds
+ * part of a read-only segment of an executable, whose frame the
+ * text cache shares.  load_segment() denies writes to the file
+ * through each text page's handle, so cached text never goes
+ * stale; read-only mappings of other files are not cached. */
+static bool
+page_is_text (struct page *page) {
+	return (page_get_type (page) == VM_FILE && !page->writable
+			&& file_page_source (page)->text);
+}
+
+/* Enters FRAME, just loaded with the text page `frame->page', into
+ * the text cache, unless a frame with the same contents is already
+ * there. */
+static void
+text_cache_insert (struct frame *frame) {
+	struct file_page *file_page = &frame->page->file;
+
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	frame->inode = file_get_inode (file_page->file);
+	frame->ofs = file_page->ofs;
+	if (hash_insert (&text_cache, &frame->cache_elem) != NULL)
+		frame->inode = NULL;
+}
+
+/* Maps PAGE, a text page, to the frame in the text cache that
+ * already holds its contents, if there is one, and returns true
+ * if so. */
+static bool
+text_cache_claim (struct page *page) {
+	struct file_page *src = file_page_source (page);
+	struct frame key, *frame = NULL;
+	struct hash_elem *e;
+
+	key.inode = file_get_inode (src->file);
+	key.ofs = src->ofs;
+
+	lock_acquire (&frame_lock);
+	e = hash_find (&text_cache, &key.cache_elem);
+	if (e != NULL) {
+		frame = hash_entry (e, struct frame, cache_elem);
+		if (frame->page->file.read_bytes == src->read_bytes
+				&& pml4_set_page (page->owner->pml4, page->va, frame->kva,
+					false)) {
+			file_page_skip_load (page);
+			frame_add_page (frame, page);
+			text_share_cnt++;
+		} else
+			frame = NULL;
+	}
+	lock_release (&frame_lock);
+	return frame != NULL;
+}
+
+/* Returns the frame under the clock hand and advances the hand,
+ * wrapping around at the end of the frame table. */
+static struct frame *
+clock_advance (void) {
+	struct frame *frame;
+
+	if (clock_hand == NULL || clock_hand == list_end (&frame_table))
+		clock_hand = list_begin (&frame_table);
+	frame = list_entry (clock_hand, struct frame, elem);
+	clock_hand = list_next (clock_hand);
+	return frame;
+}
+
+/* Returns true if any page sharing FRAME was accessed since the
+ * last call, and clears their accessed bits. */
+static bool
+frame_test_accessed (struct frame *frame) {
+	bool accessed = false;
+	struct list_elem *e;
+
+	for (e = list_begin (&frame->pages); e != list_end (&frame->pages);
+			e = list_next (e)) {
+		struct page *page = list_entry (e, struct page, share_elem);
+		uint64_t *pml4 = page->owner->pml4;
+
+		if (pml4_is_accessed (pml4, page->va)) {
+			pml4_set_accessed (pml4, page->va, false);
+			accessed = true;
+		}
+	}
+	return accessed;
+}
+
+/* Returns true if FRAME holds a file-backed page that none of its
+ * sharers has written since it was loaded, so that evicting it
+ * needs no I/O. */
+static bool
+frame_is_clean_file (struct frame *frame) {
+	struct list_elem *e;
+
+	if (page_get_type (frame->page) != VM_FILE)
+		return false;
+	for (e = list_begin (&frame->pages); e != list_end (&frame->pages);
+			e = list_next (e)) {
+		struct page *page = list_entry (e, struct page, share_elem);
+
+		if (page->dirty || pml4_is_dirty (page->owner->pml4, page->va))
+			return false;
+	}
 	return true;
 }
 
-/* Get the struct frame, that will be evicted. */
+/* Get the struct frame, that will be evicted.
+ *
+ * CLOCK (second chance): a frame whose accessed bit is set has
+ * the bit cleared and is passed over, so only frames left untouched
+ * for a whole turn of the hand are chosen.  Among those, clean
+ * file-backed frames are taken at once, since they can simply be
+ * dropped and read back later.  Otherwise the first unused frame
+ * is remembered and chosen after one full turn, so that dirty or
+ * anonymous frames are evicted only when no clean file-backed
+ * frame turns up. */
 static struct frame *
 vm_get_victim (void) {
 	struct frame *victim = NULL;
-	 /* TODO: The policy for eviction is up to you. */
+	size_t i;
+
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	for (i = 0; i < frame_cnt * 2; i++) {
+		struct frame *frame = clock_advance ();
+
+		if (frame_test_accessed (frame))
+			continue;
+		if (frame_is_clean_file (frame))
+			return frame;
+		if (victim == NULL)
+			victim = frame;
+		if (i >= frame_cnt)
+			break;
+	}
 
 	return victim;
 }
 
+/* Unmaps FRAME from every page that shares it, so that nobody can
+ * change it while it is written out, and records in each page
+ * whether it was written.  The pages stay attached to FRAME. */
+static void
+frame_unmap (struct frame *frame) {
+	struct list_elem *e;
+
+	for (e = list_begin (&frame->pages); e != list_end (&frame->pages);
+			e = list_next (e)) {
+		struct page *page = list_entry (e, struct page, share_elem);
+		uint64_t *pml4 = page->owner->pml4;
+
+		if (pml4_is_dirty (pml4, page->va))
+			page->dirty = true;
+		pml4_clear_page (pml4, page->va);
+	}
+}
+
+/* Maps FRAME back into every page that shares it, after
+ * frame_unmap() for an eviction that did not happen. */
+static void
+frame_remap (struct frame *frame) {
+	struct list_elem *e;
+
+	for (e = list_begin (&frame->pages); e != list_end (&frame->pages);
+			e = list_next (e)) {
+		struct page *page = list_entry (e, struct page, share_elem);
+		uint64_t *pml4 = page->owner->pml4;
+
+		/* The page table page is still there, so this cannot fail. */
+		if (!pml4_set_page (pml4, page->va, frame->kva,
+					page->writable && frame->ref_cnt == 1))
+			PANIC ("page table entry vanished");
+		if (page->dirty)
+			pml4_set_dirty (pml4, page->va, true);
+	}
+}
+
+/* Collects into CLUSTER the page in VICTIM followed by the
+ * anonymous pages right after it in the same address space that
+ * are in the frame table and were not accessed since the clock
+ * hand last passed them, up to SWAP_CLUSTER pages in all.  Stays
+ * within the leaf of the supplemental page table that holds
+ * VICTIM's page, which cannot go away while that page is in the
+ * frame table.  Returns the number of pages collected. */
+static size_t
+gather_cluster (struct frame *victim, struct page *cluster[]) {
+	void **leaf = spt_walk_leaf (victim->spt, (uint64_t) victim->page->va);
+	size_t idx = PTX (victim->page->va);
+	size_t cnt = 1;
+
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+	ASSERT (leaf != NULL);
+
+	cluster[0] = victim->page;
+	while (cnt < SWAP_CLUSTER && ++idx < SPT_FANOUT) {
+		struct page *page = leaf[idx];
+
+		if (page == NULL || page->frame == NULL || page->frame->pinned
+				|| page->frame->ref_cnt > 1
+				|| VM_TYPE (page->operations->type) != VM_ANON
+				|| pml4_is_accessed (victim->pml4, page->va))
+			break;
+		cluster[cnt++] = page;
+	}
+	return cnt;
+}
+
 /* Evict one page and return the corresponding frame.
  * Return NULL on error.*/
 static struct frame *
 vm_evict_frame (void) {
-	struct frame *victim UNUSED = vm_get_victim ();
-	/* TODO: swap out the victim and return the evicted frame. */
+	struct page *cluster[SWAP_CLUSTER];
+	struct frame *victim;
+	size_t cnt, i;
+	bool clean;
+
+	/* The frame lock is held through the write-out, so that the
+	 * victims' owner cannot free the pages underneath us, and so
+	 * that a fault on a victim waits until it is out. */
+	lock_acquire (&frame_lock);
+	victim = vm_get_victim ();
+	if (victim == NULL)
+		goto err;
+
+	/* The victim is unmapped before it is written, or its owner
+	 * could change it during the write and lose the change. */
+	clean = frame_is_clean_file (victim);
+	frame_unmap (victim);
+
+	/* An anonymous page goes to swap together with its idle
+	 * neighbours, in one disk command.  The neighbours are unmapped
+	 * for the write just like the victim, and those that do not fit
+	 * in the slots found are mapped back.  Their frames go back to
+	 * the user pool, ready for the next faults or for swap-in
+	 * readahead.  A file-backed frame is written back for each of
+	 * its sharers, since any of them may have written it before a
+	 * fork. */
+	cluster[0] = victim->page;
+	if (VM_TYPE (victim->page->operations->type) == VM_ANON) {
+		size_t gathered = gather_cluster (victim, cluster);
+
+		for (i = 1; i < gathered; i++)
+			frame_unmap (cluster[i]->frame);
+		cnt = anon_swap_out_cluster (cluster, gathered);
+		for (i = cnt > 1 ? cnt : 1; i < gathered; i++)
+			frame_remap (cluster[i]->frame);
+	} else {
+		struct list_elem *e;
+
+		cnt = 1;
+		for (e = list_begin (&victim->pages); e != list_end (&victim->pages);
+				e = list_next (e))
+			if (!swap_out (list_entry (e, struct page, share_elem)))
+				cnt = 0;
+	}
+	if (cnt == 0) {
+		frame_remap (victim);
+		goto err;
+	}
+
+	/* The other sharers of an anonymous frame shared copy-on-write
+	 * share its swap slot too, and each gets a copy of its own when
+	 * it faults the page back in. */
+	for (i = 0; i < cnt; i++) {
+		struct frame *frame = cluster[i]->frame;
+
+		frame_table_remove (frame);
+		while (frame->ref_cnt > 0) {
+			struct page *page = frame->page;
+
+			if (page != cluster[i]
+					&& VM_TYPE (page->operations->type) == VM_ANON)
+				anon_swap_share (cluster[i], page);
+			pml4_clear_page (page->owner->pml4, page->va);
+			page->dirty = false;
+			frame_remove_page (frame, page);
+		}
+		if (frame != victim) {
+			palloc_free_page (frame->kva);
+			kmem_cache_free (&frame_objs, frame);
+		}
+	}
+	victim->page = NULL;
+	victim->pml4 = NULL;
+	victim->spt = NULL;
+	victim->pinned = true;
 
+	evict_cnt += cnt;
+	if (clean)
+		clean_evict_cnt++;
+	lock_release (&frame_lock);
+	return victim;
+
+err:
+	lock_release (&frame_lock);
 	return NULL;
 }
 
+/* Unmaps FRAME, which is not in the frame table and holds a
+ * single page, from that page and returns its memory to the user
+ * pool. */
+static void
+vm_free_frame (struct frame *frame) {
+	struct page *page = frame->page;
+
+	pml4_clear_page (frame->pml4, page->va);
+	frame_remove_page (frame, page);
+	palloc_free_page (frame->kva);
+	kmem_cache_free (&frame_objs, frame);
+}
+
+/* Allocates a pinned frame from the user pool without evicting
+ * anything.  Returns NULL if the pool is empty. */
+static struct frame *
+vm_alloc_frame (void) {
+	struct frame *frame = kmem_cache_alloc (&frame_objs);
+
+	if (frame == NULL)
+		return NULL;
+	frame->kva = palloc_get_page (PAL_USER);
+	if (frame->kva == NULL) {
+		kmem_cache_free (&frame_objs, frame);
+		return NULL;
+	}
+	frame->page = NULL;
+	frame->pml4 = NULL;
+	frame->spt = NULL;
+	list_init (&frame->pages);
+	frame->ref_cnt = 0;
+	frame->pinned = true;
+	frame->inode = NULL;
+	return frame;
+}
+
 /* palloc() and get frame. If there is no available page, evict the page
- * and return it. This always return valid address. That is, if the user pool
- * memory is full, this function evicts the frame to get the available memory
- * space.*/
+ * and return it.  That is, if the user pool memory is full, this function
+ * evicts the frame to get the available memory space.  Returns NULL if
+ * nothing could be evicted, e.g. because swap is full. */
 static struct frame *
 vm_get_frame (void) {
-	struct frame *frame = NULL;
-	/* TODO: Fill this function. */
+	struct frame *frame = vm_alloc_frame ();
 
-	ASSERT (frame != NULL);
-	ASSERT (frame->page == NULL);
+	if (frame == NULL)
+		frame = vm_evict_frame ();
+
+	ASSERT (frame == NULL || frame->page == NULL);
 	return frame;
 }
 
@@ -125,66 +819,364 @@ vm_stack_growth (void *addr UNUSED) {
 
 /* Handle the fault on write_protected page */
 static bool
-vm_handle_wp (struct page *page UNUSED) {
+vm_handle_wp (struct page *page) {
+	uint64_t *pml4 = page->owner->pml4;
+	struct frame *frame, *copy = NULL;
+
+	if (!page->writable)
+		return false;
+
+	/* A frame still shared with another process is copied into a
+	 * frame of our own.  Getting that frame may have to evict, so
+	 * look again once we have it. */
+	lock_acquire (&frame_lock);
+	if (page->frame != NULL && page->frame->ref_cnt > 1) {
+		lock_release (&frame_lock);
+		copy = vm_get_frame ();
+		lock_acquire (&frame_lock);
+	}
+
+	frame = page->frame;
+	if (frame != NULL && frame->ref_cnt > 1) {
+		if (copy == NULL) {
+			lock_release (&frame_lock);
+			return false;
+		}
+		memcpy (copy->kva, frame->kva, PGSIZE);
+		pml4_clear_page (pml4, page->va);
+		frame_remove_page (frame, page);
+		frame_add_page (copy, page);
+		if (!pml4_set_page (pml4, page->va, copy->kva, true))
+			PANIC ("page table entry vanished");
+		frame_table_add (copy);
+		copy->pinned = false;
+		copy = NULL;
+		cow_copy_cnt++;
+	} else if (frame != NULL) {
+		/* The last sharer just takes the frame over. */
+		pml4_set_writable (pml4, page->va, true);
+	}
+	/* Otherwise the page was evicted meanwhile and the retried
+	 * access faults it back in. */
+	lock_release (&frame_lock);
+
+	if (copy != NULL) {
+		palloc_free_page (copy->kva);
+		kmem_cache_free (&frame_objs, copy);
+	}
+	return true;
+}
+
+/* Maps the pages around PAGE, a file-backed page that was just
+ * faulted in, that belong to the same mapping, within the aligned
+ * window of fault_around_pages pages that holds PAGE.  A sequential
+ * scan of a mapped file or of program text then takes one fault
+ * per window instead of one per page.  The neighbours are read into
+ * free frames only, never evicting anything for them, and come
+ * back with their accessed bits clear, so they are the first to
+ * go if they turn out not to be needed. */
+static void
+vm_fault_around (struct page *page) {
+	size_t window = fault_around_pages;
+	void **leaf;
+	size_t first, idx;
+
+	if (window > SPT_FANOUT)
+		window = SPT_FANOUT;
+	if (window <= 1)
+		return;
+
+	leaf = spt_find_leaf (&page->owner->spt, (uint64_t) page->va);
+	first = PTX (page->va) - PTX (page->va) % window;
+	for (idx = first; idx < first + window && idx < SPT_FANOUT; idx++) {
+		struct page *next = leaf[idx];
+		struct frame *frame;
+
+		if (next == NULL || next->frame != NULL
+				|| !file_page_adjacent (page, next))
+			continue;
+		if (page_is_text (next) && text_cache_claim (next)) {
+			around_cnt++;
+			continue;
+		}
+
+		frame = vm_alloc_frame ();
+		if (frame == NULL)
+			break;
+		if (!vm_map_frame (next, frame) || !swap_in (next, frame->kva)) {
+			lock_acquire (&frame_lock);
+			vm_free_frame (frame);
+			lock_release (&frame_lock);
+			break;
+		}
+
+		lock_acquire (&frame_lock);
+		frame_table_add (frame);
+		frame->pinned = false;
+		if (page_is_text (next))
+			text_cache_insert (frame);
+		lock_release (&frame_lock);
+		load_cnt++;
+		around_cnt++;
+	}
 }
 
 /* Return true on success */
 bool
-vm_try_handle_fault (struct intr_frame *f UNUSED, void *addr UNUSED,
-		bool user UNUSED, bool write UNUSED, bool not_present UNUSED) {
-	struct supplemental_page_table *spt UNUSED = &thread_current ()->spt;
-	struct page *page = NULL;
-	/* TODO: Validate the fault */
-	/* TODO: Your code goes here */
+vm_try_handle_fault (struct intr_frame *f UNUSED, void *addr,
+		bool user UNUSED, bool write UNUSED, bool not_present) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	struct page *page;
 
-	return vm_do_claim_page (page);
+	fault_cnt++;
+	if (!is_user_vaddr (addr))
+		return false;
+
+	page = spt_find_page (spt, addr);
+	if (page == NULL)
+		return false;
+
+	if (!not_present)
+		return write && vm_handle_wp (page);
+
+	/* A page that is being evicted is unmapped while it is written
+	 * out, under the frame lock.  Wait for the write to finish, so
+	 * that the page is read back only once it is all out. */
+	lock_acquire (&frame_lock);
+	lock_release (&frame_lock);
+	if (page->frame != NULL)
+		return true;
+
+	if (!vm_do_claim_page (page))
+		return false;
+	if (page_get_type (page) == VM_FILE)
+		vm_fault_around (page);
+	return true;
 }
 
-/* Free the page.
- * DO NOT MODIFY THIS FUNCTION. */
+/* Free the page. */
 void
 vm_dealloc_page (struct page *page) {
+	struct frame *frame;
+
+	lock_acquire (&frame_lock);
 	destroy (page);
-	free (page);
+	frame = page->frame;
+	if (frame != NULL) {
+		pml4_clear_page (page->owner->pml4, page->va);
+		if (frame_remove_page (frame, page) == 0) {
+			frame_table_remove (frame);
+			palloc_free_page (frame->kva);
+			kmem_cache_free (&frame_objs, frame);
+		}
+	}
+	lock_release (&frame_lock);
+	kmem_cache_free (&page_objs, page);
 }
 
 /* Claim the page that allocate on VA. */
 bool
-vm_claim_page (void *va UNUSED) {
-	struct page *page = NULL;
-	/* TODO: Fill this function */
+vm_claim_page (void *va) {
+	struct page *page = spt_find_page (&thread_current ()->spt, va);
 
+	if (page == NULL)
+		return false;
 	return vm_do_claim_page (page);
 }
 
+/* Maps FRAME, which holds PAGE, into PAGE's owner.  A frame that
+ * other pages share is mapped read-only, whatever PAGE allows. */
+static bool
+vm_map_frame (struct page *page, struct frame *frame) {
+	frame_add_page (frame, page);
+	return pml4_set_page (page->owner->pml4, page->va, frame->kva,
+			page->writable && frame->ref_cnt == 1);
+}
+
+/* Reads PAGE, an anonymous page in swap, back into its frame,
+ * which is already mapped, and returns the number of pages in
+ * CLUSTER.
+ *
+ * The pages right after PAGE in the same leaf of the supplemental
+ * page table that are in the swap slots right after PAGE's, which
+ * is where a clustered swap-out put them, are read in the same
+ * disk command, as long as there are free frames for them.  They
+ * come back mapped but with their accessed bits clear, so they
+ * are the first to go again if they turn out not to be needed.
+ * All of the frames are in CLUSTER, still pinned. */
+static size_t
+vm_swap_in_cluster (struct page *page, struct page *cluster[]) {
+	void **leaf = spt_find_leaf (&thread_current ()->spt, (uint64_t) page->va);
+	void *kvas[SWAP_CLUSTER];
+	size_t idx = PTX (page->va);
+	size_t cnt = 1;
+
+	cluster[0] = page;
+	kvas[0] = page->frame->kva;
+	while (cnt < SWAP_CLUSTER && ++idx < SPT_FANOUT) {
+		struct page *next = leaf[idx];
+		struct frame *frame;
+
+		if (next == NULL || next->frame != NULL
+				|| VM_TYPE (next->operations->type) != VM_ANON
+				|| next->anon.slot != page->anon.slot + cnt)
+			break;
+
+		frame = vm_alloc_frame ();
+		if (frame == NULL)
+			break;
+		if (!vm_map_frame (next, frame)) {
+			lock_acquire (&frame_lock);
+			vm_free_frame (frame);
+			lock_release (&frame_lock);
+			break;
+		}
+		cluster[cnt] = next;
+		kvas[cnt] = frame->kva;
+		cnt++;
+	}
+
+	anon_swap_in_cluster (cluster, kvas, cnt);
+	readahead_cnt += cnt - 1;
+	return cnt;
+}
+
 /* Claim the PAGE and set up the mmu. */
 static bool
 vm_do_claim_page (struct page *page) {
-	struct frame *frame = vm_get_frame ();
+	struct frame *frame;
+	struct page *cluster[SWAP_CLUSTER];
+	size_t cnt = 1, i;
 
-	/* Set links */
-	frame->page = page;
-	page->frame = frame;
+	/* Text that another process already has in memory needs no
+	 * frame of its own. */
+	if (page_is_text (page) && text_cache_claim (page))
+		return true;
 
-	/* TODO: Insert page table entry to map page's VA to frame's PA. */
+	frame = vm_get_frame ();
+	if (frame == NULL)
+		return false;
+	cluster[0] = page;
+	if (!vm_map_frame (page, frame))
+		goto err;
+	if (VM_TYPE (page->operations->type) == VM_ANON
+			&& page->anon.slot != SWAP_SLOT_NONE)
+		cnt = vm_swap_in_cluster (page, cluster);
+	else if (!swap_in (page, frame->kva))
+		goto err;
 
-	return swap_in (page, frame->kva);
+	/* Only fully loaded frames may be chosen for eviction. */
+	lock_acquire (&frame_lock);
+	for (i = 0; i < cnt; i++) {
+		frame_table_add (cluster[i]->frame);
+		cluster[i]->frame->pinned = false;
+	}
+	if (page_is_text (page))
+		text_cache_insert (frame);
+	lock_release (&frame_lock);
+	load_cnt += cnt;
+	return true;
+
+err:
+	lock_acquire (&frame_lock);
+	vm_free_frame (frame);
+	lock_release (&frame_lock);
+	return false;
 }
 
 /* Initialize new supplemental page table */
 void
-supplemental_page_table_init (struct supplemental_page_table *spt UNUSED) {
+supplemental_page_table_init (struct supplemental_page_table *spt) {
+	spt->root = NULL;
+	spt->page_cnt = 0;
+	spt->node_cnt = 0;
+	spt->leaf = NULL;
+	spt->leaf_tag = 0;
+}
+
+/* Copies SRC, a page of the parent, into the current thread's
+ * supplemental page table.  Pages that were never loaded are
+ * copied as they are, sharing the initializer's AUX.  Loaded pages
+ * share SRC's frame copy-on-write: both sides map it read-only,
+ * and the first to write it takes a copy in vm_handle_wp().
+ * Anonymous pages in swap share SRC's swap slot in the same way,
+ * and each side reads its own copy back when it faults. */
+static bool
+copy_page (struct page *src, void *aux UNUSED) {
+	struct thread *curr = thread_current ();
+	struct page *dst;
+	struct frame *frame;
+
+	if (VM_TYPE (src->operations->type) == VM_UNINIT) {
+		void *aux = src->uninit.aux;
+
+		/* A file to load from needs a handle of the child's own. */
+		if (src->uninit.init == file_page_load) {
+			aux = file_page_duplicate (aux);
+			if (aux == NULL)
+				return false;
+		}
+		if (!vm_alloc_page_with_initializer (src->uninit.type, src->va,
+					src->writable, src->uninit.init, aux)) {
+			if (aux != src->uninit.aux)
+				file_page_free (aux);
+			return false;
+		}
+		return true;
+	}
+
+	dst = kmem_cache_alloc (&page_objs);
+	if (dst == NULL)
+		return false;
+	*dst = *src;
+	dst->owner = curr;
+	dst->frame = NULL;
+	dst->dirty = false;
+	if (VM_TYPE (dst->operations->type) == VM_ANON)
+		dst->anon.slot = SWAP_SLOT_NONE;
+	if (VM_TYPE (dst->operations->type) == VM_FILE) {
+		dst->file.file = file_reopen (src->file.file);
+		if (dst->file.file == NULL) {
+			kmem_cache_free (&page_objs, dst);
+			return false;
+		}
+	}
+	if (!spt_insert_page (&curr->spt, dst)) {
+		destroy (dst);
+		kmem_cache_free (&page_objs, dst);
+		return false;
+	}
+
+	lock_acquire (&frame_lock);
+	frame = src->frame;
+	if (frame != NULL) {
+		frame_add_page (frame, dst);
+		if (!pml4_set_page (curr->pml4, dst->va, frame->kva, false)) {
+			lock_release (&frame_lock);
+			return false;
+		}
+		pml4_set_writable (src->owner->pml4, src->va, false);
+		cow_share_cnt++;
+	} else if (VM_TYPE (src->operations->type) == VM_ANON
+			&& src->anon.slot != SWAP_SLOT_NONE)
+		anon_swap_share (src, dst);
+	lock_release (&frame_lock);
+	return true;
 }
 
 /* Copy supplemental page table from src to dst */
 bool
 supplemental_page_table_copy (struct supplemental_page_table *dst UNUSED,
-		struct supplemental_page_table *src UNUSED) {
+		struct supplemental_page_table *src) {
+	ASSERT (dst == &thread_current ()->spt);
+
+	return spt_for_each (src, NULL, (void *) SPT_END, copy_page, NULL);
 }
 
 /* Free the resource hold by the supplemental page table */
 void
-supplemental_page_table_kill (struct supplemental_page_table *spt UNUSED) {
-	/* TODO: Destroy all the supplemental_page_table hold by thread and
-	 * TODO: writeback all the modified contents to the storage. */
+supplemental_page_table_kill (struct supplemental_page_table *spt) {
+	spt_remove_range (spt, NULL, (void *) SPT_END);
+	ASSERT (spt->root == NULL);
+	ASSERT (spt->page_cnt == 0);
 }